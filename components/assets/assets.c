@@ -0,0 +1,177 @@
+/**
+ *  Fonts and images stored in a flash partition
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "assets.h"
+
+static const char *TAG = "assets";
+
+/* Pack mapped into the address space, NULL if there is none */
+static const assets_header_t *s_header;
+static spi_flash_mmap_handle_t s_mmap_handle;
+/* Result of mapping the pack, which is only attempted once */
+static bool s_init_done;
+static esp_err_t s_init_err;
+
+static const assets_entry_t *assets_entries(void)
+{
+    return (const assets_entry_t *) (s_header + 1);
+}
+
+static esp_err_t assets_map(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ASSETS_PARTITION_SUBTYPE, ASSETS_PARTITION_NAME);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // only map as much as the pack takes, address space for mapping is scarce
+    assets_header_t header;
+    esp_err_t err = esp_partition_read(part, 0, &header, sizeof(header));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (header.magic != ASSETS_MAGIC) {
+        // partition was never written
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (header.version != ASSETS_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    size_t index_end = sizeof(header) + header.count * sizeof(assets_entry_t);
+    if (header.size > part->size || header.size < index_end) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const void *ptr;
+    err = esp_partition_mmap(part, 0, header.size, SPI_FLASH_MMAP_DATA, &ptr, &s_mmap_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_header = ptr;
+    // check the index once, so that lookups can rely on it
+    for (int i = 0; i < header.count; ++i) {
+        const assets_entry_t *entry = &assets_entries()[i];
+        if (entry->offset < index_end || entry->offset > header.size ||
+                entry->offset % 4 != 0 || entry->size > header.size - entry->offset) {
+            spi_flash_munmap(s_mmap_handle);
+            s_header = NULL;
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    ESP_LOGI(TAG, "%d assets, %u bytes", header.count, (unsigned) header.size);
+    return ESP_OK;
+}
+
+esp_err_t assets_init(void)
+{
+    if (!s_init_done) {
+        s_init_err = assets_map();
+        if (s_init_err != ESP_OK) {
+            ESP_LOGW(TAG, "no asset pack (%s)", esp_err_to_name(s_init_err));
+        }
+        s_init_done = true;
+    }
+    return s_init_err;
+}
+
+esp_err_t assets_find(const char *name, asset_type_t type, const void **data, size_t *size)
+{
+    if (assets_init() != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (int i = 0; i < s_header->count; ++i) {
+        const assets_entry_t *entry = &assets_entries()[i];
+        if (entry->type == type && strncmp(entry->name, name, ASSETS_NAME_LEN) == 0) {
+            *data = (const uint8_t *) s_header + entry->offset;
+            *size = entry->size;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* Compressed image; the rest of the data is checked while decoding */
+static esp_err_t assets_get_qoi(const char *name, asset_image_t *out)
+{
+    const uint8_t *data;
+    size_t size;
+    esp_err_t err = assets_find(name, ASSET_TYPE_QOI, (const void **) &data, &size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // header: "qoif", width and height (big endian uint32_t), channels, colorspace
+    if (size < 14 || memcmp(data, "qoif", 4) != 0 || data[4] || data[5] || data[8] || data[9]) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    out->width = (data[6] << 8) | data[7];
+    out->height = (data[10] << 8) | data[11];
+    out->pixels = NULL;
+    out->qoi = data;
+    out->qoi_size = size;
+    return ESP_OK;
+}
+
+esp_err_t assets_get_image(const char *name, asset_image_t *out)
+{
+    const uint8_t *data;
+    size_t size;
+    esp_err_t err = assets_find(name, ASSET_TYPE_IMAGE, (const void **) &data, &size);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return assets_get_qoi(name, out);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (size < 4) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    out->width = data[0] | (data[1] << 8);
+    out->height = data[2] | (data[3] << 8);
+    // the pixel count fits in 32 bits, its size in bytes may not
+    if ((size_t) out->width * out->height > (size - 4) / sizeof(uint16_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    out->pixels = (const uint16_t *) (data + 4);
+    out->qoi = NULL;
+    out->qoi_size = 0;
+    return ESP_OK;
+}
+
+esp_err_t assets_get_font(const char *name, asset_font_t *out)
+{
+    const uint8_t *data;
+    size_t size;
+    esp_err_t err = assets_find(name, ASSET_TYPE_FONT, (const void **) &data, &size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (size < 4) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    out->width = data[0];
+    out->height = data[1];
+    out->first = data[2];
+    out->count = data[3];
+    size_t glyph_size = out->height * ((out->width + 7) / 8);
+    if (out->count * glyph_size > size - 4) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    out->glyphs = data + 4;
+    return ESP_OK;
+}
+
+const uint8_t *asset_font_glyph(const asset_font_t *font, char c)
+{
+    int index = (uint8_t) c - font->first;
+    if (index < 0 || index >= font->count) {
+        return NULL;
+    }
+    return font->glyphs + index * font->height * ((font->width + 7) / 8);
+}
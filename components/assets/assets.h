@@ -0,0 +1,96 @@
+/**
+ *  Fonts and images stored in a flash partition
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The asset pack is kept in a data partition with this name and subtype.
+ * It is built by tools/mkassets.py and can be written without rebuilding
+ * the application:
+ *   parttool.py write_partition --partition-name assets --input assets.bin
+ */
+#define ASSETS_PARTITION_NAME       "assets"
+#define ASSETS_PARTITION_SUBTYPE    0x40
+
+/* Layout of the pack; all fields are little endian, offsets are from the
+ * start of the pack. Keep in sync with tools/mkassets.py.
+ */
+#define ASSETS_MAGIC        0x53415754  /* "TWAS" */
+#define ASSETS_VERSION      1
+#define ASSETS_NAME_LEN     16
+
+/** @enum Kinds of assets */
+typedef enum {
+    ASSET_TYPE_FONT = 1,
+    ASSET_TYPE_IMAGE = 2,
+    ASSET_TYPE_QOI = 3,
+} asset_type_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;     /* number of index entries following the header */
+    uint32_t size;      /* of the whole pack */
+} assets_header_t;
+
+typedef struct {
+    char name[ASSETS_NAME_LEN];     /* zero padded */
+    uint32_t type;                  /* asset_type_t */
+    uint32_t offset;                /* of the data, 4-byte aligned */
+    uint32_t size;
+} assets_entry_t;
+
+/* Image data: width, height (uint16_t each), then RGB565 pixels row by row,
+ * in the byte order they are sent to the LCD. Compressed images are stored
+ * as QOI files instead, and are drawn with st7735_draw_qoi.
+ */
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    const uint16_t *pixels;     /* NULL if the image is compressed */
+    const uint8_t *qoi;
+    size_t qoi_size;
+} asset_image_t;
+
+/* Font data: cell width, height, first character, number of characters
+ * (uint8_t each), then the glyphs, 1 bit per pixel as st7735_draw_bitmap
+ * expects: each row starts at a byte boundary, MSB is the leftmost pixel.
+ */
+typedef struct {
+    uint8_t width;
+    uint8_t height;
+    uint8_t first;
+    uint8_t count;
+    const uint8_t *glyphs;
+} asset_font_t;
+
+/* Map the asset partition into the address space. Called by the functions
+ * below when needed; the data stays mapped and is read directly from flash.
+ */
+esp_err_t assets_init(void);
+
+/* Find an asset; returns ESP_ERR_NOT_FOUND if there is none with this name
+ * and type, or if there is no valid asset pack.
+ */
+esp_err_t assets_find(const char *name, asset_type_t type, const void **data, size_t *size);
+/* Find an image, either uncompressed or compressed */
+esp_err_t assets_get_image(const char *name, asset_image_t *out);
+esp_err_t assets_get_font(const char *name, asset_font_t *out);
+
+/* Bitmap of a character of a font, or NULL if the font doesn't have it */
+const uint8_t *asset_font_glyph(const asset_font_t *font, char c);
+
+#ifdef __cplusplus
+}
+#endif
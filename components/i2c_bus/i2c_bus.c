@@ -0,0 +1,144 @@
+/**
+ *  Shared I2C bus with prepared transfers
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "i2c_bus.h"
+
+#define ACK_CHECK_EN 0x1
+
+// register transfers take well under a millisecond at 400 kHz
+#define I2C_BUS_TIMEOUT_MS  20
+
+#define I2C_BUS_TASK_PRIORITY   6
+#define I2C_BUS_TASK_STACK      2048
+#define I2C_BUS_QUEUE_LEN       4
+
+typedef struct {
+    i2c_bus_xfer_t *xfer;
+    i2c_bus_done_cb_t cb;
+    void *arg;
+} i2c_bus_request_t;
+
+static void i2c_bus_task(void *arg);
+
+static QueueHandle_t s_queue;
+static const char *TAG = "i2c_bus";
+
+esp_err_t i2c_bus_init(i2c_port_t port, int sda_pin, int scl_pin, uint32_t clk_speed)
+{
+    esp_err_t err = i2c_driver_install(port, I2C_MODE_MASTER, 0, 0, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = sda_pin,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_io_num = scl_pin,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = clk_speed
+    };
+    err = i2c_param_config(port, &conf);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // one task serves all ports
+    if (s_queue == NULL) {
+        s_queue = xQueueCreate(I2C_BUS_QUEUE_LEN, sizeof(i2c_bus_request_t));
+        if (s_queue == NULL ||
+                xTaskCreate(&i2c_bus_task, "i2c_bus", I2C_BUS_TASK_STACK, NULL,
+                            I2C_BUS_TASK_PRIORITY, NULL) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ESP_LOGD(TAG, "port %d, %u Hz", port, (unsigned) clk_speed);
+    return ESP_OK;
+}
+
+void i2c_bus_prepare_read(i2c_bus_xfer_t *xfer, i2c_port_t port, uint8_t addr,
+                          uint8_t reg, uint8_t *data, size_t len)
+{
+    assert(len > 0);
+    *xfer = (i2c_bus_xfer_t) {
+        .port = port,
+        .addr = addr,
+        .read = true,
+        .reg = reg,
+        .data = data,
+        .len = len
+    };
+}
+
+void i2c_bus_prepare_write(i2c_bus_xfer_t *xfer, i2c_port_t port, uint8_t addr,
+                           uint8_t *data, size_t len)
+{
+    // at least the register and one value
+    assert(len > 1);
+    *xfer = (i2c_bus_xfer_t) {
+        .port = port,
+        .addr = addr,
+        .read = false,
+        .data = data,
+        .len = len
+    };
+}
+
+esp_err_t i2c_bus_run(i2c_bus_xfer_t *xfer)
+{
+    // the link is consumed by i2c_master_cmd_begin, so it is built every time
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, xfer->addr << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN);
+    if (xfer->read) {
+        i2c_master_write_byte(cmd, xfer->reg, ACK_CHECK_EN);
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, xfer->addr << 1 | I2C_MASTER_READ, ACK_CHECK_EN);
+        i2c_master_read(cmd, xfer->data, xfer->len, I2C_MASTER_LAST_NACK);
+    } else {
+        i2c_master_write(cmd, xfer->data, xfer->len, ACK_CHECK_EN);
+    }
+    i2c_master_stop(cmd);
+    // the driver serializes transfers on each port
+    esp_err_t err = i2c_master_cmd_begin(xfer->port, cmd, I2C_BUS_TIMEOUT_MS / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    return err;
+}
+
+esp_err_t i2c_bus_run_async(i2c_bus_xfer_t *xfer, i2c_bus_done_cb_t cb, void *arg)
+{
+    assert(s_queue != NULL);
+    i2c_bus_request_t req = {
+        .xfer = xfer,
+        .cb = cb,
+        .arg = arg
+    };
+    if (xQueueSend(s_queue, &req, 0) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static void i2c_bus_task(void *arg)
+{
+    while (true) {
+        i2c_bus_request_t req;
+        xQueueReceive(s_queue, &req, portMAX_DELAY);
+        esp_err_t err = i2c_bus_run(req.xfer);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "transfer failed (%s)", esp_err_to_name(err));
+        }
+        req.cb(req.xfer, err, req.arg);
+    }
+}
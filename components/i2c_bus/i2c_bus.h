@@ -0,0 +1,70 @@
+/**
+ *  Shared I2C bus with prepared transfers
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Register access over I2C, for drivers of devices which are accessed often
+ * with the same registers (RTC, IMU). A transfer is described once, and
+ * run as often as needed.
+ *
+ * Before IDF 4.4, i2c_master_cmd_begin consumes the command link it runs
+ * (data pointers and byte counts are advanced in place), so a link can't
+ * be reused: each run builds the commands from the description again.
+ * The driver allocates them from the heap, as IDF 4.2 has no way to give
+ * it memory for them; the link is freed when the run is finished.
+ *
+ * The data buffer is referenced, not copied. A read transfer stores the
+ * registers into it each time it runs; a write transfer sends what it
+ * holds at the time it runs.
+ */
+typedef struct {
+    i2c_port_t port;
+    uint8_t addr;
+    bool read;
+    uint8_t reg;        /* first register of a read */
+    uint8_t *data;
+    size_t len;
+} i2c_bus_xfer_t;
+
+/* Called from the I2C task when an asynchronous transfer is finished */
+typedef void (*i2c_bus_done_cb_t)(i2c_bus_xfer_t *xfer, esp_err_t err, void *arg);
+
+/* Install the I2C driver as master, and start the task which runs
+ * asynchronous transfers. PCF8563 and the IMU support fast mode, 400 kHz.
+ */
+esp_err_t i2c_bus_init(i2c_port_t port, int sda_pin, int scl_pin, uint32_t clk_speed);
+
+/* Burst read of 'len' registers starting at 'reg' into 'data' */
+void i2c_bus_prepare_read(i2c_bus_xfer_t *xfer, i2c_port_t port, uint8_t addr,
+                          uint8_t reg, uint8_t *data, size_t len);
+/* Burst write: data[0] is the first register, followed by len - 1 values.
+ * The register is kept in the same buffer, so that the whole write is
+ * sent from it and nothing is copied.
+ */
+void i2c_bus_prepare_write(i2c_bus_xfer_t *xfer, i2c_port_t port, uint8_t addr,
+                           uint8_t *data, size_t len);
+
+/* Run a prepared transfer, blocking until it is finished */
+esp_err_t i2c_bus_run(i2c_bus_xfer_t *xfer);
+/* Queue a prepared transfer to the I2C task and return. 'cb' is called
+ * when it is finished; the buffer must not be used until then.
+ */
+esp_err_t i2c_bus_run_async(i2c_bus_xfer_t *xfer, i2c_bus_done_cb_t cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,15 +6,12 @@
  */
 
 #include <time.h>
+#include <stdbool.h>
 #include "esp_log.h"
-#include "driver/i2c.h"
+#include "sys/lock.h"
+#include "i2c_bus.h"
 #include "pcf8563.h"
 
-#define ACK_CHECK_EN 0x1
-#define ACK_CHECK_DIS 0x0
-#define ACK_VAL 0x0
-#define NACK_VAL 0x1
-
 #define PCF8563_CTRL1_REG  0x00
 #define PCF8563_CTRL2_REG  0x01
 #define PCF8563_SEC_REG  0x02
@@ -31,6 +28,19 @@
 #define PCF8563_MON_MASK 0x1f
 #define PCF8563_YEAR_REG  0x08      /* 0 to 99 */
 #define PCF8563_YEAR_MASK 0xff
+#define PCF8563_MIN_ALARM_REG  0x09 /* minute, hour, day, weekday alarm */
+#define PCF8563_ALARM_DISABLE  0x80 /* AE bit: the field isn't compared */
+#define PCF8563_TIMER_CTRL_REG  0x0e
+#define PCF8563_TIMER_ENABLE   0x80
+#define PCF8563_TIMER_REG  0x0f
+
+/* CTRL2 bits. Flags are cleared by writing 0, writing 1 leaves them as is. */
+#define PCF8563_CTRL2_TIE   0x01    /* timer interrupt enable */
+#define PCF8563_CTRL2_AIE   0x02    /* alarm interrupt enable */
+#define PCF8563_CTRL2_TF    PCF8563_FLAG_TIMER
+#define PCF8563_CTRL2_AF    PCF8563_FLAG_ALARM
+#define PCF8563_CTRL2_TI_TP 0x10    /* INT pulses instead of following TF */
+#define PCF8563_CTRL2_FLAGS (PCF8563_CTRL2_TF | PCF8563_CTRL2_AF)
 
 
 typedef struct {
@@ -68,9 +78,19 @@ typedef struct {
 _Static_assert(sizeof(pcf8563_datetime_t) == PCF8563_YEAR_REG - PCF8563_SEC_REG + 1,
                "incorrect size of pcf8563_datetime_t");
 
+/* Buffer of a register write: the first register, then the values */
+typedef struct {
+    uint8_t reg;
+    pcf8563_datetime_t datetime;
+} pcf8563_datetime_write_t;
+
+_Static_assert(sizeof(pcf8563_datetime_write_t) == sizeof(pcf8563_datetime_t) + 1,
+               "incorrect size of pcf8563_datetime_write_t");
+
 
-static esp_err_t pcf8563_read(uint8_t reg, uint8_t *result, size_t len);
-static esp_err_t pcf8563_write(uint8_t reg, const uint8_t *data, size_t len);
+static void pcf8563_time_read_done(i2c_bus_xfer_t *xfer, esp_err_t err, void *arg);
+static uint8_t pcf8563_update_ctrl2(uint8_t enable, uint8_t disable, uint8_t clear);
+static bcd_t alarm_field(int val);
 static void pcf8563_datetime_to_tm(const pcf8563_datetime_t *in, struct tm *out);
 static void pcf8563_tm_to_datetime(const struct tm *in, pcf8563_datetime_t *out);
 static int bcd_to_int(bcd_t val, uint8_t mask);
@@ -78,71 +98,181 @@ static bcd_t int_to_bcd(int val);
 static void log_tm(const char *comment, const struct tm *in);
 
 
-static i2c_port_t s_i2c_port;
 const uint8_t s_slave_addr = 0x51;
 static const char *TAG = "pcf8563";
 
+/* Transfers are described in pcf8563_init; the buffers they use are only
+ * touched with s_lock held, except for the asynchronous read which has its
+ * own buffer.
+ */
+static _lock_t s_lock;
+static uint8_t s_ctrl[2];
+static i2c_bus_xfer_t s_read_ctrl;
+static pcf8563_datetime_t s_datetime;
+static i2c_bus_xfer_t s_read_time;
+static pcf8563_datetime_write_t s_datetime_write = { .reg = PCF8563_SEC_REG };
+static i2c_bus_xfer_t s_write_time;
+static uint8_t s_ctrl2_write[2] = { PCF8563_CTRL2_REG };
+static i2c_bus_xfer_t s_write_ctrl2;
+static uint8_t s_alarm_write[5] = { PCF8563_MIN_ALARM_REG };
+static i2c_bus_xfer_t s_write_alarm;
+/* timer control and value; control alone is written from the same buffer */
+static uint8_t s_timer_write[3] = { PCF8563_TIMER_CTRL_REG };
+static i2c_bus_xfer_t s_write_timer;
+static i2c_bus_xfer_t s_write_timer_ctrl;
+
+static pcf8563_datetime_t s_async_datetime;
+static i2c_bus_xfer_t s_read_time_async;
+static pcf8563_time_cb_t s_async_cb;
+static void *s_async_arg;
+static volatile bool s_async_busy;
+
 void pcf8563_init(int i2c_port)
 {
-    s_i2c_port = i2c_port;
-    uint8_t val;
-    esp_err_t err = pcf8563_read(PCF8563_CTRL1_REG, &val, 1);
+    i2c_bus_prepare_read(&s_read_ctrl, i2c_port, s_slave_addr,
+                         PCF8563_CTRL1_REG, s_ctrl, sizeof(s_ctrl));
+    i2c_bus_prepare_read(&s_read_time, i2c_port, s_slave_addr,
+                         PCF8563_SEC_REG, (uint8_t *) &s_datetime, sizeof(s_datetime));
+    i2c_bus_prepare_write(&s_write_time, i2c_port, s_slave_addr,
+                          (uint8_t *) &s_datetime_write, sizeof(s_datetime_write));
+    i2c_bus_prepare_read(&s_read_time_async, i2c_port, s_slave_addr, PCF8563_SEC_REG,
+                         (uint8_t *) &s_async_datetime, sizeof(s_async_datetime));
+    i2c_bus_prepare_write(&s_write_ctrl2, i2c_port, s_slave_addr,
+                          s_ctrl2_write, sizeof(s_ctrl2_write));
+    i2c_bus_prepare_write(&s_write_alarm, i2c_port, s_slave_addr,
+                          s_alarm_write, sizeof(s_alarm_write));
+    i2c_bus_prepare_write(&s_write_timer, i2c_port, s_slave_addr,
+                          s_timer_write, sizeof(s_timer_write));
+    i2c_bus_prepare_write(&s_write_timer_ctrl, i2c_port, s_slave_addr,
+                          s_timer_write, 2);
+
+    // check that the chip responds
+    _lock_acquire(&s_lock);
+    esp_err_t err = i2c_bus_run(&s_read_ctrl);
+    _lock_release(&s_lock);
     ESP_ERROR_CHECK(err);
 }
 
 void pcf8563_get_time(struct tm *out)
 {
-    pcf8563_datetime_t datetime;
-    esp_err_t err = pcf8563_read(PCF8563_SEC_REG, (uint8_t *) &datetime, sizeof(datetime));
-    ESP_LOG_BUFFER_HEX(TAG, &datetime, sizeof(datetime));
+    _lock_acquire(&s_lock);
+    esp_err_t err = i2c_bus_run(&s_read_time);
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, &s_datetime, sizeof(s_datetime), ESP_LOG_DEBUG);
+    pcf8563_datetime_to_tm(&s_datetime, out);
+    _lock_release(&s_lock);
     ESP_ERROR_CHECK(err);
-    pcf8563_datetime_to_tm(&datetime, out);
     log_tm(__func__, out);
 }
 
+esp_err_t pcf8563_get_time_async(pcf8563_time_cb_t cb, void *arg)
+{
+    _lock_acquire(&s_lock);
+    if (s_async_busy) {
+        _lock_release(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_async_busy = true;
+    s_async_cb = cb;
+    s_async_arg = arg;
+    _lock_release(&s_lock);
+
+    esp_err_t err = i2c_bus_run_async(&s_read_time_async, &pcf8563_time_read_done, NULL);
+    if (err != ESP_OK) {
+        s_async_busy = false;
+    }
+    return err;
+}
+
+static void pcf8563_time_read_done(i2c_bus_xfer_t *xfer, esp_err_t err, void *arg)
+{
+    struct tm tm = {};
+    if (err == ESP_OK) {
+        pcf8563_datetime_to_tm(&s_async_datetime, &tm);
+    }
+    pcf8563_time_cb_t cb = s_async_cb;
+    void *cb_arg = s_async_arg;
+    // the callback may start the next read
+    s_async_busy = false;
+    cb(&tm, err, cb_arg);
+}
+
 void pcf8563_set_time(const struct tm *in)
 {
-    pcf8563_datetime_t datetime;
-    pcf8563_tm_to_datetime(in, &datetime);
     log_tm(__func__, in);
-    ESP_LOG_BUFFER_HEX(TAG, &datetime, sizeof(datetime));
-    esp_err_t err = pcf8563_write(PCF8563_SEC_REG, (const uint8_t *) &datetime, sizeof(datetime));
+    _lock_acquire(&s_lock);
+    pcf8563_tm_to_datetime(in, &s_datetime_write.datetime);
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, &s_datetime_write.datetime, sizeof(s_datetime_write.datetime), ESP_LOG_DEBUG);
+    esp_err_t err = i2c_bus_run(&s_write_time);
+    _lock_release(&s_lock);
     ESP_ERROR_CHECK(err);
 }
 
-static esp_err_t pcf8563_read(uint8_t reg, uint8_t *result, size_t len)
+void pcf8563_set_alarm(const pcf8563_alarm_t *alarm)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, s_slave_addr << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, reg, ACK_CHECK_EN);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, s_slave_addr << 1 | I2C_MASTER_READ, ACK_CHECK_EN);
-    if (len > 1) {
-        i2c_master_read(cmd, result, len - 1, ACK_VAL);
-    }
-    i2c_master_read_byte(cmd, result + len - 1, NACK_VAL);
-    i2c_master_stop(cmd);
+    _lock_acquire(&s_lock);
+    s_alarm_write[1] = alarm_field(alarm->minute).val;
+    s_alarm_write[2] = alarm_field(alarm->hour).val;
+    s_alarm_write[3] = alarm_field(alarm->day).val;
+    s_alarm_write[4] = alarm_field(alarm->weekday).val;
+    ESP_ERROR_CHECK(i2c_bus_run(&s_write_alarm));
+    pcf8563_update_ctrl2(PCF8563_CTRL2_AIE, 0, PCF8563_CTRL2_AF);
+    _lock_release(&s_lock);
+}
 
-    esp_err_t ret = i2c_master_cmd_begin(s_i2c_port, cmd, 200 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+void pcf8563_disable_alarm(void)
+{
+    _lock_acquire(&s_lock);
+    pcf8563_update_ctrl2(0, PCF8563_CTRL2_AIE, PCF8563_CTRL2_AF);
+    _lock_release(&s_lock);
 }
 
-static esp_err_t pcf8563_write(uint8_t reg, const uint8_t *data, size_t len)
+void pcf8563_set_timer(pcf8563_timer_clock_t clock, uint8_t count)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, s_slave_addr << 1 | I2C_MASTER_WRITE, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, reg, ACK_CHECK_EN);
-    for (size_t i = 0; i < len; i++) {
-        i2c_master_write_byte(cmd, data[i], ACK_CHECK_EN);
-    }
-    i2c_master_stop(cmd);
+    assert(count > 0);
+    _lock_acquire(&s_lock);
+    // load the value with the timer stopped, then start it
+    s_timer_write[1] = clock;
+    s_timer_write[2] = count;
+    ESP_ERROR_CHECK(i2c_bus_run(&s_write_timer));
+    s_timer_write[1] = clock | PCF8563_TIMER_ENABLE;
+    ESP_ERROR_CHECK(i2c_bus_run(&s_write_timer_ctrl));
+    // INT stays active until TF is cleared, so that it can wake up from deep sleep
+    pcf8563_update_ctrl2(PCF8563_CTRL2_TIE, PCF8563_CTRL2_TI_TP, PCF8563_CTRL2_TF);
+    _lock_release(&s_lock);
+}
+
+void pcf8563_disable_timer(void)
+{
+    _lock_acquire(&s_lock);
+    // a stopped timer also saves power; the 1/60 Hz clock setting draws the least
+    s_timer_write[1] = PCF8563_TIMER_1_60HZ;
+    ESP_ERROR_CHECK(i2c_bus_run(&s_write_timer_ctrl));
+    pcf8563_update_ctrl2(0, PCF8563_CTRL2_TIE, PCF8563_CTRL2_TF);
+    _lock_release(&s_lock);
+}
+
+uint8_t pcf8563_clear_flags(void)
+{
+    _lock_acquire(&s_lock);
+    uint8_t flags = pcf8563_update_ctrl2(0, 0, PCF8563_CTRL2_FLAGS);
+    _lock_release(&s_lock);
+    return flags;
+}
 
-    esp_err_t ret = i2c_master_cmd_begin(s_i2c_port, cmd, 200 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+/* Read-modify-write of CTRL2, called with s_lock held. Returns the flags
+ * which were set before.
+ */
+static uint8_t pcf8563_update_ctrl2(uint8_t enable, uint8_t disable, uint8_t clear)
+{
+    ESP_ERROR_CHECK(i2c_bus_run(&s_read_ctrl));
+    uint8_t ctrl2 = s_ctrl[1];
+    uint8_t val = (ctrl2 & (PCF8563_CTRL2_TIE | PCF8563_CTRL2_AIE | PCF8563_CTRL2_TI_TP)) | enable;
+    val &= ~disable;
+    // a flag set after the read is kept, since 1 is written to the ones not cleared
+    val |= PCF8563_CTRL2_FLAGS & ~clear;
+    s_ctrl2_write[1] = val;
+    ESP_ERROR_CHECK(i2c_bus_run(&s_write_ctrl2));
+    return ctrl2 & PCF8563_CTRL2_FLAGS;
 }
 
 static void pcf8563_datetime_to_tm(const pcf8563_datetime_t *in, struct tm *out)
@@ -181,6 +311,16 @@ static int bcd_to_int(bcd_t val, uint8_t mask)
     return tmp.low + 10 * tmp.high;
 }
 
+static bcd_t alarm_field(int val)
+{
+    if (val < 0) {
+        return (bcd_t) {
+            .val = PCF8563_ALARM_DISABLE
+        };
+    }
+    return int_to_bcd(val);
+}
+
 static bcd_t int_to_bcd(int val)
 {
     assert(val < 100);
@@ -193,8 +333,12 @@ static bcd_t int_to_bcd(int val)
 
 static void log_tm(const char *comment, const struct tm *in)
 {
+    // don't format the time if it isn't going to be printed
+    if (LOG_LOCAL_LEVEL < ESP_LOG_DEBUG) {
+        return;
+    }
     char buf[64];
     if (strftime(buf, sizeof(buf), "%A %c", in)) {
-        ESP_LOGI(TAG, "%s: %s", comment, buf);
+        ESP_LOGD(TAG, "%s: %s", comment, buf);
     }
 }
\ No newline at end of file
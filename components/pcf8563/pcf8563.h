@@ -1,13 +1,63 @@
 #pragma once
 
+#include <time.h>
+#include "esp_err.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Called from the I2C task when an asynchronous read is finished */
+typedef void (*pcf8563_time_cb_t)(const struct tm *tm, esp_err_t err, void *arg);
+
+/* Prepare the transfers on the given port, set up with i2c_bus_init */
 void pcf8563_init(int i2c_port);
 void pcf8563_get_time(struct tm *out);
+/* Read the time without waiting for the bus. Returns ESP_ERR_INVALID_STATE
+ * if the previous read hasn't finished yet.
+ */
+esp_err_t pcf8563_get_time_async(pcf8563_time_cb_t cb, void *arg);
 void pcf8563_set_time(const struct tm *in);
 
+/* Alarm and timer both pull the INT pin low while their flag is set and
+ * their interrupt is enabled. The pin stays low until the flags are cleared.
+ */
+
+/* Flags returned by pcf8563_clear_flags */
+#define PCF8563_FLAG_TIMER  0x04
+#define PCF8563_FLAG_ALARM  0x08
+
+/* Alarm time; fields set to -1 aren't compared, so e.g. an alarm with only
+ * the minute set goes off every hour.
+ */
+typedef struct {
+    int minute;
+    int hour;
+    int day;        /* 1 to 31 */
+    int weekday;    /* 0 to 6 */
+} pcf8563_alarm_t;
+
+/** @enum Clock of the countdown timer */
+typedef enum {
+    PCF8563_TIMER_4096HZ,
+    PCF8563_TIMER_64HZ,
+    PCF8563_TIMER_1HZ,
+    PCF8563_TIMER_1_60HZ,
+} pcf8563_timer_clock_t;
+
+/* Set the alarm and enable its interrupt; clears the alarm flag */
+void pcf8563_set_alarm(const pcf8563_alarm_t *alarm);
+void pcf8563_disable_alarm(void);
+/* Start the countdown timer, which goes off every 'count' periods of 'clock',
+ * and enable its interrupt; clears the timer flag.
+ */
+void pcf8563_set_timer(pcf8563_timer_clock_t clock, uint8_t count);
+void pcf8563_disable_timer(void);
+/* Clear the alarm and timer flags, releasing the INT pin.
+ * Returns the flags which were set (PCF8563_FLAG_*).
+ */
+uint8_t pcf8563_clear_flags(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,21 +10,54 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <assert.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/param.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_log.h"
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "st7735.h"
 #include "st7735_defs.h"
+#include "st7735_qoi.h"
 
-static void st7735_commands(const uint8_t *commands);
+static void st7735_commands_start(const uint8_t *commands);
+static void st7735_commands_step(void *arg);
+static void st7735_bus_wait(void);
+#if CONFIG_ST7735_COLOR_12BIT
+static void st7735_pack_finish(void);
+#endif
+static int64_t st7735_cmd_ready_at(uint8_t cmd);
+static void st7735_cmd_sent(uint8_t cmd);
 
 static void st7735_send_command(uint8_t);
-static void st7735_send_data8(uint8_t);
+static void st7735_send_cmd(uint8_t cmd, const uint8_t *args, size_t len);
 static void st7735_send_data16(uint16_t, int repeat);
-static void st7735_delay_ms(uint8_t);
+static uint32_t st7735_queue(const void *data, size_t len, uint32_t flags);
+static void st7735_wait_trans(uint32_t seq);
 static void st7735_fill_color565(uint16_t color, uint16_t count);
+static void st7735_lcd_set_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1);
+static void st7735_write_start(void);
+static uint32_t st7735_write_pixels(const uint16_t *pixels, int count);
+static uint32_t st7735_send_pixels(const uint16_t *pixels, size_t count);
+
+#if CONFIG_ST7735_FRAMEBUFFER
+static void st7735_fb_set_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1);
+static void st7735_fb_write(const uint16_t *pixels, int step, int count);
+static void st7735_fb_mark_dirty(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1);
+static void st7735_fb_flush(void);
+static void st7735_fb_put(int x, int y, const uint16_t *pixels, int step, int count);
+static void st7735_fb_get(uint16_t *out, int x, int y, int count);
+#endif
+#if CONFIG_ST7735_FB_PALETTE
+static void st7735_palette_reset(void);
+#endif
 
 static void st7735_logical_to_lcd(int *x, int *y);
 
@@ -34,36 +67,32 @@ static const uint8_t st7735_init_commands[] = {
     11,
     // Software reset
     //  no arguments
-    //  delay
     SWRESET,
-    DELAY,
-    200,  // 200 ms delay
+    0,
     // Out of sleep mode,
-    //  no arguments,
-    //  delay
+    //  no arguments
     SLPOUT,
-    DELAY,
-    200,  // 200 ms delay
+    0,
     // Set color mode,
     //  1 argument
-    //  delay
     COLMOD,
-    1 + DELAY,
+    1,
+#if CONFIG_ST7735_COLOR_12BIT
+    0x03,  // 12-bit color
+#else
     0x05,  // 16-bit color
-    10,  // 10 ms
+#endif
     // Frame rate control,
     //  3 arguments
-    //  delay
     FRMCTR1,
-    3 + DELAY,
+    3,
     0x00,  // fastest refresh
     0x06,  // 6 lines front porch
     0x03,  // 3 lines back porch
-    10,  // 10 ms delay
-    // Inversion mode off
+    // Inversion mode off,
+    //  reset default
     INVOFF,
-    DELAY,
-    10,
+    RESET_DEFAULT,
     // Memory access ctrl (directions),
     //  1 argument
     //  no delay
@@ -106,10 +135,9 @@ static const uint8_t st7735_init_commands[] = {
     // 0xA0 = 1010 0000
     (BIT(7) | BIT(5) | BIT(3)),
     // Display settings #5,
-    //  2 arguments
-    //  no delay
+    //  2 arguments, reset default
     DISSET5,
-    2,
+    2 + RESET_DEFAULT,
     0x15,  // 1 clk cycle nonoverlap, 2 cycle gate
     // rise, 3 cycle osc equalize
     0x02,  // Fix on VTL
@@ -142,9 +170,8 @@ static const uint8_t st7735_init_commands[] = {
     0x0E,
     // Sparkles and rainbows
     //  16 arguments
-    //  delay
     GMCTRN1,
-    16 + DELAY,
+    16,
     0x0B,
     0x14,
     0x08,
@@ -161,13 +188,10 @@ static const uint8_t st7735_init_commands[] = {
     0x06,
     0x02,
     0x0F,
-    10,  // 10 ms delay
-    // Normal display on
-    //  no arguments
-    //  delay
+    // Normal display on,
+    //  reset default
     NORON,
-    DELAY,
-    10,  // 10 ms delay
+    RESET_DEFAULT,
     /*
         // Main screen turn on
         //  no arguments
@@ -177,6 +201,53 @@ static const uint8_t st7735_init_commands[] = {
               200   // 200 ms delay
     */
 };
+/** @array Commands to wake up from sleep, keeping the LCD memory and settings */
+static const uint8_t st7735_wake_commands[] = {
+    2,
+    // Out of sleep mode,
+    //  no arguments
+    SLPOUT,
+    0,
+    // Memory access ctrl, in case the rotation has changed
+    //  1 argument, replaced with the current rotation
+    MADCTL,
+    1,
+    (BIT(7) | BIT(5) | BIT(3)),
+};
+/** @array Commands to enter sleep mode */
+static const uint8_t st7735_sleep_commands[] = {
+    1,
+    SLPIN,
+    0,
+};
+
+// matches any command in st7735_cmd_timing_t
+#define CMD_ANY 0xff
+
+/** @struct Minimal time between two commands */
+typedef struct {
+    uint8_t after;      // command sent first
+    uint8_t before;     // command sent later, or CMD_ANY
+    uint32_t delay_us;  // time between the end of 'after' and the start of 'before'
+} st7735_cmd_timing_t;
+
+/** @array Command timing requirements, from the ST7735S datasheet */
+static const st7735_cmd_timing_t st7735_cmd_timings[] = {
+    { SWRESET, CMD_ANY, 5000 },
+    // reset puts the LCD into sleep mode
+    { SWRESET, SLPOUT, 120000 },
+    // supply voltages and clocks have to stabilize
+    { SLPOUT, CMD_ANY, 5000 },
+    { SLPOUT, SLPIN, 120000 },
+    { SLPIN, CMD_ANY, 5000 },
+    { SLPIN, SLPOUT, 120000 },
+};
+#define ST7735_CMD_TIMINGS_COUNT (sizeof(st7735_cmd_timings) / sizeof(st7735_cmd_timings[0]))
+// time when the 'after' command of each timing entry was last sent,
+// entries with commands not sent since startup are not set in the mask
+static int64_t s_cmd_sent_at[ST7735_CMD_TIMINGS_COUNT];
+static uint32_t s_cmd_sent_mask;
+
 /** @array Charset */
 const uint8_t CHARACTERS[][5] = {
     { 0x00, 0x00, 0x00, 0x00, 0x00 }, // 20 space
@@ -280,11 +351,177 @@ const uint8_t CHARACTERS[][5] = {
 int s_cur_y = 0;
 int s_cur_x = 0;
 
+#if CONFIG_ST7735_CHECK_TIMING
+static const char *TAG = "st7735";
+#endif
 static spi_device_handle_t s_spi_dev;
 
+// number of transactions which can be queued at a time
+#define ST7735_QUEUE_SIZE 7
+// flags passed to SPI callbacks in spi_transaction_t::user
+#define TRANS_DC     BIT(0)     // D/C line level
+
+// transaction descriptors for the queued transfers, used as a ring
+static spi_transaction_t s_trans[ST7735_QUEUE_SIZE];
+// next free descriptor
+static int s_trans_head;
+// number of descriptors queued but not yet reclaimed
+static int s_trans_in_flight;
+// sequence numbers of the last queued and the last finished transaction
+static uint32_t s_trans_seq;
+static uint32_t s_trans_done;
+static st7735_stats_t s_stats;
+
+// command arguments longer than what fits into a transaction are copied here
+#define ST7735_ARGS_BUF_LEN 16
+static DMA_ATTR uint8_t s_args_buf[ST7735_ARGS_BUF_LEN];
+static uint32_t s_args_seq;
+
+// window last set on the LCD, to skip CASET/RASET if it doesn't change
+static uint8_t s_lcd_win[4];
+static bool s_lcd_win_valid;
+
+// number of pixels in the buffer used for solid color fills
+#define ST7735_FILL_BUF_LEN 512
+// solid color fills are sent from this buffer, as many times as needed
+static DMA_ATTR uint16_t s_fill_buf[ST7735_FILL_BUF_LEN];
+// color the buffer is currently filled with
+static uint16_t s_fill_color;
+static bool s_fill_valid;
+
+// number of pixels in each of the band buffers
+#define ST7735_BAND_LEN 512
+// pixel data rendered on the fly is sent from these two buffers in turns,
+// so that the next band can be rendered while the previous one is sent
+static DMA_ATTR uint16_t s_band[2][ST7735_BAND_LEN];
+// sequence number of the last transfer from each band buffer
+static uint32_t s_band_seq[2];
+static int s_band_idx;
+
+// command list being sent in the background, and the number of commands left
+static const uint8_t *s_cmd_list;
+static uint8_t s_cmd_left;
+// fires when the delay required after a command is over
+static esp_timer_handle_t s_cmd_timer;
+// given when the command list is finished and the bus is free again
+static SemaphoreHandle_t s_cmd_done;
+// set while a command list is in progress
+static volatile bool s_cmd_busy;
+// task currently sending the commands, it doesn't have to wait for the bus
+static volatile TaskHandle_t s_cmd_owner;
+
+// MADCTL bits
+#define MADCTL_MY   BIT(7)  // row address order
+#define MADCTL_MX   BIT(6)  // column address order
+#define MADCTL_MV   BIT(5)  // row / column exchange
+#define MADCTL_BGR  BIT(3)  // BGR color filter panel
+
+// GRAM is 132 x 162, the panel shows 80 x 160 of it: columns [26, 106)
+// and rows [2, 162) with MADCTL = 0. Mirroring an axis moves the offset
+// to the other end of GRAM.
+#define GRAM_ROWS   162
+#define PANEL_LONG  MAX_X
+#define PANEL_SHORT (MAX_Y - MIN_Y)
+
+/** @struct Settings of each rotation */
+typedef struct {
+    uint8_t madctl;
+    uint8_t width;      // logical size
+    uint8_t height;
+    uint8_t x_offset;   // GRAM address of logical x = 0, y = 0
+    uint8_t y_offset;
+} st7735_rotation_cfg_t;
+
+static const st7735_rotation_cfg_t s_rotations[] = {
+    [ST7735_ROTATION_0] = {
+        MADCTL_MY | MADCTL_MV | MADCTL_BGR, PANEL_LONG, PANEL_SHORT, 0, MIN_Y
+    },
+    [ST7735_ROTATION_90] = {
+        MADCTL_BGR, PANEL_SHORT, PANEL_LONG, MIN_Y, GRAM_ROWS - PANEL_LONG
+    },
+    [ST7735_ROTATION_180] = {
+        MADCTL_MX | MADCTL_MV | MADCTL_BGR, PANEL_LONG, PANEL_SHORT, GRAM_ROWS - PANEL_LONG, MIN_Y
+    },
+    [ST7735_ROTATION_270] = {
+        MADCTL_MX | MADCTL_MY | MADCTL_BGR, PANEL_SHORT, PANEL_LONG, MIN_Y, 0
+    },
+};
+static st7735_rotation_t s_rotation = ST7735_ROTATION_0;
+// logical size of the screen, for the current rotation
+static uint8_t s_width = PANEL_LONG;
+static uint8_t s_height = PANEL_SHORT;
+
+#if CONFIG_ST7735_COLOR_12BIT
+// number of pixels converted to 12-bit format at a time
+#define ST7735_PACK_LEN 512
+// pixels converted to 12-bit format are sent from these two buffers in turns
+static DMA_ATTR uint8_t s_pack[2][ST7735_PACK_LEN * 3 / 2];
+static uint32_t s_pack_seq[2];
+static int s_pack_idx;
+// two pixels take three bytes; an odd pixel is kept here until the next one
+static uint16_t s_pack_carry;
+static bool s_pack_carry_valid;
+// number of 12-bit pixel pairs which fit into the solid color fill buffer
+#define ST7735_FILL_PAIRS (sizeof(s_fill_buf) / 3)
+#endif
+
+#if CONFIG_ST7735_FRAMEBUFFER
+// framebuffer covers the visible area only, in logical coordinates;
+// rows are s_width pixels long
+#define FB_PIXELS (PANEL_LONG * PANEL_SHORT)
+// number of separate dirty rectangles tracked before they get merged
+#define FB_DIRTY_RECTS_MAX 4
+
+/** @struct Rectangle, all coordinates inclusive */
+typedef struct {
+    uint8_t x0, x1, y0, y1;
+} st7735_rect_t;
+
+#if CONFIG_ST7735_FB_RGB565
+// RGB565 pixels, stored in the same byte order as they are sent to the LCD.
+// Statically allocated in internal RAM, so can be used as a DMA source.
+static DMA_ATTR uint16_t s_fb[FB_PIXELS];
+#elif CONFIG_ST7735_FB_8BPP
+// palette indices, one byte per pixel
+#define FB_PALETTE_LEN 256
+static uint8_t s_fb[FB_PIXELS];
+#elif CONFIG_ST7735_FB_4BPP
+// palette indices, two pixels per byte, the left one in the upper nibble
+#define FB_PALETTE_LEN 16
+static uint8_t s_fb[FB_PIXELS / 2];
+#endif
+#if CONFIG_ST7735_FB_PALETTE
+// colors of the indices stored in the framebuffer, in the byte order they
+// are sent in. Index 0 is black, so that the initial framebuffer is black.
+static uint16_t s_palette[FB_PALETTE_LEN];
+static int s_palette_count = 1;
+// number of entries installed with st7735_set_palette, these are never reused
+static int s_palette_fixed = 1;
+// entries not referenced by any pixel, found when the palette is full
+static bool s_palette_free[FB_PALETTE_LEN];
+// cleared after looking for unused entries, until the next update
+static bool s_palette_collect_allowed = true;
+// last two colors looked up in the palette, most recent first
+static uint16_t s_palette_mru_color[2];
+static uint8_t s_palette_mru_index[2];
+#endif
+// window and write position, emulating LCD GRAM write semantics
+static st7735_rect_t s_fb_win;
+static int s_fb_x;
+static int s_fb_y;
+static bool s_fb_win_dirty;
+// regions which have to be sent to the LCD on the next update
+static st7735_rect_t s_fb_dirty[FB_DIRTY_RECTS_MAX];
+static int s_fb_dirty_count;
+// set while the flush of the framebuffer is in progress
+static bool s_fb_busy;
+// set while restoring the framebuffer contents to match the LCD
+static bool s_fb_restoring;
+#endif // CONFIG_ST7735_FRAMEBUFFER
+
 void lcd_spi_pre_transfer_callback(spi_transaction_t *t)
 {
-    int dc = (int)t->user;
+    int dc = (uintptr_t)t->user & TRANS_DC;
     gpio_set_level(TFT_DC, dc);
 }
 
@@ -300,10 +537,10 @@ static void st7735_spi_init(void)
         .max_transfer_sz = CACHE_SIZE_MEM * 2
     };
     spi_device_interface_config_t devcfg = {
-        .clock_speed_hz = 10 * 1000 * 1000,     //Clock out at 10 MHz
+        .clock_speed_hz = CONFIG_ST7735_SPI_CLOCK_MHZ * 1000 * 1000,
         .mode = 0,                              //SPI mode 0
         .spics_io_num = TFT_CS,             //CS pin
-        .queue_size = 7,                        //We want to be able to queue 7 transactions at a time
+        .queue_size = ST7735_QUEUE_SIZE,        //We want to be able to queue 7 transactions at a time
         .pre_cb = lcd_spi_pre_transfer_callback, //Specify pre-transfer callback to handle D/C line
     };
     //Initialize the SPI bus
@@ -314,152 +551,574 @@ static void st7735_spi_init(void)
     ESP_ERROR_CHECK(ret);
 }
 
-void st7735_init(void)
+void st7735_init_start(bool warm)
 {
     st7735_spi_init();
-    // load list of commands
-    st7735_commands(st7735_init_commands);
+    s_lcd_win_valid = false;
+    if (warm) {
+        // everything else was kept by the LCD in sleep mode
+        st7735_commands_start(st7735_wake_commands);
+    } else {
+        // load list of commands
+        st7735_commands_start(st7735_init_commands);
+    }
+}
+
+void st7735_init_wait(void)
+{
+    if (!s_cmd_busy) {
+        return;
+    }
+    xSemaphoreTake(s_cmd_done, portMAX_DELAY);
+    xSemaphoreGive(s_cmd_done);
+}
+
+void st7735_init(void)
+{
+    st7735_init_start(false);
+    st7735_init_wait();
+}
+
+void st7735_init_warm(void)
+{
+    st7735_init_start(true);
+    st7735_init_wait();
 }
 
-static void st7735_commands(const uint8_t *commands)
+void st7735_sleep(void)
 {
-    uint8_t milliseconds;
-    uint8_t numOfCommands;
-    uint8_t numOfArguments;
+    st7735_commands_start(st7735_sleep_commands);
+    st7735_init_wait();
+}
+
+void st7735_set_idle_mode(bool enable)
+{
+    st7735_send_cmd(enable ? IDMON : IDMOFF, NULL, 0);
+}
+
+/* Time at which 'cmd' can be sent, according to the timing table.
+ * With CMD_ANY, the time at which any command can be sent.
+ */
+static int64_t st7735_cmd_ready_at(uint8_t cmd)
+{
+    int64_t ready_at = 0;
+    for (int i = 0; i < ST7735_CMD_TIMINGS_COUNT; ++i) {
+        const st7735_cmd_timing_t *timing = &st7735_cmd_timings[i];
+        if (!(s_cmd_sent_mask & BIT(i)) ||
+                (timing->before != cmd && timing->before != CMD_ANY)) {
+            continue;
+        }
+        int64_t delay = (int64_t) timing->delay_us * CONFIG_ST7735_INIT_DELAY_PERCENT / 100;
+        ready_at = MAX(ready_at, s_cmd_sent_at[i] + delay);
+    }
+    return ready_at;
+}
+
+#if CONFIG_ST7735_CHECK_TIMING
+/* Check that a command isn't sent too early */
+static void st7735_cmd_check(uint8_t cmd)
+{
+    int64_t early = st7735_cmd_ready_at(cmd) - esp_timer_get_time();
+    if (early > 0) {
+        ESP_LOGE(TAG, "command 0x%02x sent %d us too early", cmd, (int) early);
+    }
+}
+#endif
 
+/* Record the time a command was sent; delays count from the end of it */
+static void st7735_cmd_sent(uint8_t cmd)
+{
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < ST7735_CMD_TIMINGS_COUNT; ++i) {
+        if (st7735_cmd_timings[i].after == cmd) {
+            s_cmd_sent_at[i] = now;
+            s_cmd_sent_mask |= BIT(i);
+        }
+    }
+}
+
+/* Start sending a list of commands. Delays required between the commands
+ * are done with a timer, so the caller can do something else in the meantime.
+ * Drawing functions wait for the list to finish before using the bus.
+ */
+static void st7735_commands_start(const uint8_t *commands)
+{
+    if (s_cmd_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = &st7735_commands_step,
+            .name = "st7735_cmd"
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_cmd_timer));
+        s_cmd_done = xSemaphoreCreateBinary();
+        assert(s_cmd_done);
+    }
+    st7735_init_wait();
+    xSemaphoreTake(s_cmd_done, 0);
     // number of commands
-    numOfCommands = *(commands++);
+    s_cmd_left = *(commands++);
+    s_cmd_list = commands;
+    s_cmd_busy = true;
+    st7735_commands_step(NULL);
+}
 
+/* Send commands from the list until one which can't be sent yet */
+static void st7735_commands_step(void *arg)
+{
+    const uint8_t *commands = s_cmd_list;
+    int64_t wait_us = 0;
+
+    s_cmd_owner = xTaskGetCurrentTaskHandle();
     // loop through whole command list
-    while (numOfCommands--) {
-        // send command
-        st7735_send_command(*(commands++));
+    while (s_cmd_left) {
+        uint8_t command = commands[0];
         // read number of arguments
-        numOfArguments = *(commands++);
-        // check if delay set
-        milliseconds = numOfArguments & DELAY;
-        // remove delay flag
-        numOfArguments &= ~DELAY;
-        // loop through number of arguments
-        while (numOfArguments--) {
-            // send arguments
-            st7735_send_data8(*(commands++));
+        uint8_t numOfArguments = commands[1] & ~RESET_DEFAULT;
+#if CONFIG_ST7735_INIT_SKIP_RESET_DEFAULTS
+        if (commands[1] & RESET_DEFAULT) {
+            s_cmd_left--;
+            commands += 2 + numOfArguments;
+            continue;
+        }
+#endif
+        // the previous command has to be finished for its time to be known
+        st7735_flush();
+        wait_us = st7735_cmd_ready_at(command) - esp_timer_get_time();
+        if (wait_us > 0) {
+            break;
         }
-        // check if delay set
-        if (milliseconds) {
-            // value in milliseconds
-            milliseconds = *(commands++);
-            // delay
-            st7735_delay_ms(milliseconds);
+        // send command and all its arguments
+        if (command == MADCTL) {
+            // orientation set by st7735_set_rotation
+            st7735_send_cmd(command, &s_rotations[s_rotation].madctl, 1);
+        } else {
+            st7735_send_cmd(command, commands + 2, numOfArguments);
         }
+        s_cmd_left--;
+        commands += 2 + numOfArguments;
+    }
+    s_cmd_list = commands;
+    st7735_flush();
+    if (!s_cmd_left) {
+        // release the bus once any other command can follow
+        wait_us = st7735_cmd_ready_at(CMD_ANY) - esp_timer_get_time();
+    }
+    s_cmd_owner = NULL;
+    if (wait_us > 0) {
+        ESP_ERROR_CHECK(esp_timer_start_once(s_cmd_timer, wait_us));
+        return;
+    }
+    s_cmd_busy = false;
+    xSemaphoreGive(s_cmd_done);
+}
+
+/* Wait for the command list in progress, unless called while sending it */
+static void st7735_bus_wait(void)
+{
+    if (s_cmd_busy && s_cmd_owner != xTaskGetCurrentTaskHandle()) {
+        st7735_init_wait();
+    }
+}
+
+static void st7735_reclaim(void)
+{
+    spi_transaction_t *t;
+    ESP_ERROR_CHECK(spi_device_get_trans_result(s_spi_dev, &t, portMAX_DELAY));
+    --s_trans_in_flight;
+    ++s_trans_done;
+}
+
+/* Wait until transaction with sequence number 'seq' is finished */
+static void st7735_wait_trans(uint32_t seq)
+{
+    while ((int32_t)(s_trans_done - seq) < 0) {
+        st7735_reclaim();
     }
 }
 
+/* Send 'len' bytes from 'data'. Up to 4 bytes are copied into the transaction,
+ * longer buffers have to stay valid until the transaction is finished.
+ * Returns the sequence number of the transaction.
+ */
+static uint32_t st7735_queue(const void *data, size_t len, uint32_t flags)
+{
+    st7735_bus_wait();
+#if CONFIG_ST7735_COLOR_12BIT
+    if (!(flags & TRANS_DC) && s_pack_carry_valid) {
+        // the last pixel of the previous RAMWR is still waiting for a pair
+        st7735_pack_finish();
+    }
+#endif
+    s_stats.transactions++;
+    s_stats.bytes += len;
+    if (!(flags & TRANS_DC)) {
+        s_stats.commands++;
+#if CONFIG_ST7735_CHECK_TIMING
+        st7735_cmd_check(*(const uint8_t *) data);
+#endif
+    }
+    if (len <= 4 && s_trans_in_flight == 0) {
+        // bus is idle, polling is cheaper than an interrupt for short transfers
+        spi_transaction_t t = {
+            .flags = SPI_TRANS_USE_TXDATA,
+            .length = len * 8,
+            .user = (void *)(uintptr_t) flags
+        };
+        memcpy(t.tx_data, data, len);
+        ESP_ERROR_CHECK(spi_device_polling_transmit(s_spi_dev, &t));
+        if (!(flags & TRANS_DC)) {
+            st7735_cmd_sent(*(const uint8_t *) data);
+        }
+        s_trans_done = ++s_trans_seq;
+        return s_trans_seq;
+    }
+    if (s_trans_in_flight == ST7735_QUEUE_SIZE) {
+        // all descriptors in use, wait for the oldest one
+        st7735_reclaim();
+    }
+    spi_transaction_t *t = &s_trans[s_trans_head];
+    s_trans_head = (s_trans_head + 1) % ST7735_QUEUE_SIZE;
+    *t = (spi_transaction_t) {
+        .length = len * 8,
+        .user = (void *)(uintptr_t) flags
+    };
+    if (len <= 4) {
+        t->flags = SPI_TRANS_USE_TXDATA;
+        memcpy(t->tx_data, data, len);
+    } else {
+        t->tx_buffer = data;
+    }
+    ESP_ERROR_CHECK(spi_device_queue_trans(s_spi_dev, t, portMAX_DELAY));
+    if (!(flags & TRANS_DC)) {
+        // ends later; commands followed by delays are sent by st7735_commands_step
+        // after a flush, so they are polled
+        st7735_cmd_sent(*(const uint8_t *) data);
+    }
+    ++s_trans_in_flight;
+    return ++s_trans_seq;
+}
+
+void st7735_flush(void)
+{
+    st7735_bus_wait();
+    while (s_trans_in_flight > 0) {
+        st7735_reclaim();
+    }
+#if CONFIG_ST7735_FRAMEBUFFER
+    s_fb_busy = false;
+#endif
+}
 
 static void st7735_send_command(uint8_t data)
 {
-    esp_err_t ret;
-    spi_transaction_t t = {};
-    t.length = 8;                   //Command is 8 bits
-    t.tx_buffer = &data;             //The data is the cmd itself
-    t.user = (void *)0;             //D/C needs to be set to 0
-    ret = spi_device_polling_transmit(s_spi_dev, &t); //Transmit!
-    ESP_ERROR_CHECK(ret);
+    st7735_queue(&data, 1, 0);  //D/C needs to be set to 0
 }
 
-static void st7735_send_data8(uint8_t data)
+/* Send a command and its arguments. The D/C line can only change between
+ * transactions, so this is two transactions: the opcode, then all arguments.
+ */
+static void st7735_send_cmd(uint8_t cmd, const uint8_t *args, size_t len)
 {
-    esp_err_t ret;
-    spi_transaction_t t = {};
-    t.length = 8;               //Len is in bytes, transaction length is in bits.
-    t.tx_buffer = &data;             //Data
-    t.user = (void *)1;             //D/C needs to be set to 1
-    ret = spi_device_polling_transmit(s_spi_dev, &t); //Transmit!
-    ESP_ERROR_CHECK(ret);
+    st7735_send_command(cmd);
+    if (len == 0) {
+        return;
+    }
+    if (len > 4) {
+        // doesn't fit into the transaction; 'args' may be in flash or on stack
+        assert(len <= ST7735_ARGS_BUF_LEN);
+        st7735_wait_trans(s_args_seq);
+        memcpy(s_args_buf, args, len);
+        args = s_args_buf;
+    }
+    uint32_t seq = st7735_queue(args, len, TRANS_DC);
+    if (args == s_args_buf) {
+        s_args_seq = seq;
+    }
+}
+
+void st7735_get_stats(st7735_stats_t *out)
+{
+    *out = s_stats;
+    // 8 bits per byte, clock in MHz gives microseconds
+    out->bus_time_us = (uint64_t) s_stats.bytes * 8 / CONFIG_ST7735_SPI_CLOCK_MHZ;
+}
+
+void st7735_reset_stats(void)
+{
+    s_stats = (st7735_stats_t) {};
+}
+
+#if CONFIG_ST7735_COLOR_12BIT
+
+/* Convert pairs of RGB565 pixels (in the byte order they are sent in) to
+ * 12-bit format: R1G1 B1R2 G2B2, 4 bits per component. Both pixels of a pair
+ * are converted at once, using 32-bit operations and no branches.
+ */
+static void st7735_pack12(uint8_t *out, const uint16_t *in, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; ++i) {
+        // bytes of the 1st pixel in bits 0..15, of the 2nd one in bits 16..31
+        uint32_t w = in[0] | ((uint32_t) in[1] << 16);
+        in += 2;
+        // top 4 bits of each component: R in bits 4..7, G and B in bits 0..3
+        uint32_t r = w & 0x00f000f0;
+        uint32_t g = ((w & 0x00070007) << 1) | ((w >> 15) & 0x00010001);
+        uint32_t b = (w >> 9) & 0x000f000f;
+        uint32_t rg = r | g;
+        out[0] = rg;
+        out[1] = ((b << 4) & 0xf0) | ((rg >> 20) & 0x0f);
+        out[2] = ((rg >> 12) & 0xf0) | ((b >> 16) & 0x0f);
+        out += 3;
+    }
+}
+
+/* Send the odd pixel left at the end of a pixel stream */
+static void st7735_pack_finish(void)
+{
+    uint16_t pair[2] = { s_pack_carry, 0 };
+    uint8_t bytes[3];
+    st7735_pack12(bytes, pair, 1);
+    s_pack_carry_valid = false;
+    // the unused half of the last byte is ignored by the LCD
+    st7735_queue(bytes, 2, TRANS_DC);
+}
+
+/* Pair the pixel left from the previous stream with 'pixel' and send them */
+static uint32_t st7735_pack_carry(uint16_t pixel)
+{
+    uint16_t pair[2] = { s_pack_carry, pixel };
+    uint8_t bytes[3];
+    st7735_pack12(bytes, pair, 1);
+    s_pack_carry_valid = false;
+    return st7735_queue(bytes, sizeof(bytes), TRANS_DC);
+}
+
+/* Convert and send pixels. 'pixels' can be reused as soon as this returns. */
+static uint32_t st7735_send_pixels(const uint16_t *pixels, size_t count)
+{
+    uint32_t seq = s_trans_seq;
+    if (s_pack_carry_valid && count > 0) {
+        seq = st7735_pack_carry(*pixels++);
+        --count;
+    }
+    while (count >= 2) {
+        size_t chunk = MIN(count & ~1, ST7735_PACK_LEN);
+        s_pack_idx ^= 1;
+        st7735_wait_trans(s_pack_seq[s_pack_idx]);
+        st7735_pack12(s_pack[s_pack_idx], pixels, chunk / 2);
+        seq = st7735_queue(s_pack[s_pack_idx], chunk * 3 / 2, TRANS_DC);
+        s_pack_seq[s_pack_idx] = seq;
+        pixels += chunk;
+        count -= chunk;
+    }
+    if (count) {
+        s_pack_carry = *pixels;
+        s_pack_carry_valid = true;
+    }
+    return seq;
 }
 
 static void st7735_send_data16(uint16_t data, int repeat)
 {
-    esp_err_t ret;
-    uint16_t *alloc_data = NULL;
-    spi_transaction_t t = {};
-    t.length = 16 * repeat;               //Len is in bytes, transaction length is in bits.
-    if (repeat == 1) {
-        t.tx_buffer = &data;             //Data
-    } else {
-        alloc_data = malloc(sizeof(uint16_t) * repeat);
-        assert(alloc_data);
+    if (s_pack_carry_valid && repeat > 0) {
+        st7735_pack_carry(data);
+        --repeat;
+    }
+    if (repeat <= 2) {
+        uint16_t pair[2] = { data, data };
+        st7735_send_pixels(pair, repeat);
+        return;
+    }
+    if (!s_fill_valid || s_fill_color != data) {
+        // buffer may still be used by queued transfers of another color
+        st7735_flush();
+        // fill the buffer with as many pixel pairs as fit, 3 bytes each
+        uint16_t pair[2] = { data, data };
+        uint8_t *fill = (uint8_t *) s_fill_buf;
+        st7735_pack12(fill, pair, 1);
+        for (int i = 3; i < ST7735_FILL_PAIRS * 3; ++i) {
+            fill[i] = fill[i - 3];
+        }
+        s_fill_color = data;
+        s_fill_valid = true;
+    }
+    // send the same buffer as many times as needed
+    while (repeat >= 2) {
+        int pairs = MIN(repeat / 2, ST7735_FILL_PAIRS);
+        st7735_queue(s_fill_buf, pairs * 3, TRANS_DC);
+        repeat -= pairs * 2;
+    }
+    if (repeat) {
+        s_pack_carry = data;
+        s_pack_carry_valid = true;
+    }
+}
+
+#else // CONFIG_ST7735_COLOR_12BIT
+
+static uint32_t st7735_send_pixels(const uint16_t *pixels, size_t count)
+{
+    return st7735_queue(pixels, sizeof(uint16_t) * count, TRANS_DC);
+}
+
+static void st7735_send_data16(uint16_t data, int repeat)
+{
+    if (repeat <= 2) {
+        // fits into the transaction itself
+        uint16_t pair[2] = { data, data };
+        if (repeat > 0) {
+            st7735_queue(pair, sizeof(uint16_t) * repeat, TRANS_DC);
+        }
+        return;
+    }
+    if (!s_fill_valid || s_fill_color != data) {
+        // buffer may still be used by queued transfers of another color
+        st7735_flush();
         if ((data & 0xff) == (data >> 8)) {
-            memset(alloc_data, (data & 0xff), repeat * 2);
+            memset(s_fill_buf, (data & 0xff), sizeof(s_fill_buf));
         } else {
-            for (int i = 0; i < repeat; ++i) {
-                alloc_data[i] = data;
+            for (int i = 0; i < ST7735_FILL_BUF_LEN; ++i) {
+                s_fill_buf[i] = data;
             }
         }
-        t.tx_buffer = alloc_data;
+        s_fill_color = data;
+        s_fill_valid = true;
     }
-    t.user = (void *)1;             //D/C needs to be set to 1
-    ret = spi_device_polling_transmit(s_spi_dev, &t); //Transmit!
-    ESP_ERROR_CHECK(ret);
-    if (alloc_data) {
-        free(alloc_data);
+    // send the same buffer as many times as needed
+    while (repeat > 0) {
+        int chunk = MIN(repeat, ST7735_FILL_BUF_LEN);
+        st7735_queue(s_fill_buf, sizeof(uint16_t) * chunk, TRANS_DC);
+        repeat -= chunk;
     }
 }
 
+#endif // CONFIG_ST7735_COLOR_12BIT
+
 static void st7735_fill_color565(uint16_t color, uint16_t count)
 {
+#if CONFIG_ST7735_FRAMEBUFFER
+    // render into RAM, sent to the LCD in st7735_update_screen
+    st7735_fb_write(&color, 0, count);
+#else
     // access to RAM
     st7735_send_command(RAMWR);
     // write color
     st7735_send_data16(color, count);
+#endif
+}
+
+/* Start writing pixels into the window set by st7735_set_window */
+static void st7735_write_start(void)
+{
+#if !CONFIG_ST7735_FRAMEBUFFER
+    st7735_send_command(RAMWR);
+#endif
+}
+
+/* Write pixels at the current position in the window. Returns the sequence
+ * number of the transfer; 'pixels' must not be modified until it finishes.
+ */
+static uint32_t st7735_write_pixels(const uint16_t *pixels, int count)
+{
+#if CONFIG_ST7735_FRAMEBUFFER
+    // copied right away, nothing to wait for
+    st7735_fb_write(pixels, 1, count);
+    return s_trans_done;
+#else
+    return st7735_send_pixels(pixels, count);
+#endif
+}
+
+/* Get the next band buffer, once it is no longer used by a previous transfer */
+static uint16_t *st7735_band_get(void)
+{
+    s_band_idx ^= 1;
+    st7735_wait_trans(s_band_seq[s_band_idx]);
+    return s_band[s_band_idx];
+}
+
+/* Write 'count' pixels from the band buffer returned by st7735_band_get */
+static void st7735_band_send(int count)
+{
+    s_band_seq[s_band_idx] = st7735_write_pixels(s_band[s_band_idx], count);
 }
 
 uint8_t st7735_set_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1)
 {
     // check if coordinates is out of range
     if ((x0 > x1)     ||
-            (x1 > MAX_X) ||
+            (x1 >= s_width) ||
             (y0 > y1)     ||
-            (y1 > MAX_Y)) {
+            (y1 >= s_height)) {
         // out of range
         return 0;
     }
-    // column address set
-    st7735_send_command(CASET);
-    // start x position
-    st7735_send_data8(0x00);
-    // start x position
-    st7735_send_data8(x0);
-    // start x position
-    st7735_send_data8(0x00);
-    // end x position
-    st7735_send_data8(x1);
-    // row address set
-    st7735_send_command(RASET);
-    // start x position
-    st7735_send_data8(0x00);
-    // start y position
-    st7735_send_data8(y0);
-    // start x position
-    st7735_send_data8(0x00);
-    // end y position
-    st7735_send_data8(y1);
+#if CONFIG_ST7735_FRAMEBUFFER
+    st7735_fb_set_window(x0, x1, y0, y1);
+#else
+    st7735_lcd_set_window(x0, x1, y0, y1);
+#endif
     // success
     return 1;
 }
 
+static void st7735_lcd_set_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1)
+{
+    if (s_lcd_win_valid &&
+            s_lcd_win[0] == x0 && s_lcd_win[1] == x1 &&
+            s_lcd_win[2] == y0 && s_lcd_win[3] == y1) {
+        // window is kept by the LCD, RAMWR starts at its top left corner again
+        return;
+    }
+    int xs = x0, ys = y0, xe = x1, ye = y1;
+    st7735_logical_to_lcd(&xs, &ys);
+    st7735_logical_to_lcd(&xe, &ye);
+    // column address set: start x position, end x position
+    uint8_t caset[] = { 0x00, xs, 0x00, xe };
+    st7735_send_cmd(CASET, caset, sizeof(caset));
+    // row address set: start y position, end y position
+    uint8_t raset[] = { 0x00, ys, 0x00, ye };
+    st7735_send_cmd(RASET, raset, sizeof(raset));
+    s_lcd_win[0] = x0;
+    s_lcd_win[1] = x1;
+    s_lcd_win[2] = y0;
+    s_lcd_win[3] = y1;
+    s_lcd_win_valid = true;
+}
+
+/* Set the window on the LCD and send pixels, without going through the
+ * framebuffer. 'pixels' must stay valid until the returned transaction is done.
+ */
+static uint32_t st7735_lcd_write_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1,
+                                        const uint16_t *pixels, size_t count)
+{
+    st7735_lcd_set_window(x0, x1, y0, y1);
+    st7735_send_command(RAMWR);
+    return st7735_send_pixels(pixels, count);
+}
+
+bool st7735_write_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1,
+                         const uint16_t *pixels, size_t count)
+{
+    if (!st7735_set_window(x0, x1, y0, y1)) {
+        return false;
+    }
+    st7735_write_start();
+    st7735_write_pixels(pixels, count);
+    return true;
+}
+
 bool st7735_set_position(uint8_t x, uint8_t y)
 {
     // check if coordinates is out of range
-    if ((x > MAX_X - (CHARS_COLS_LEN + 1)) &&
-            (y > MAX_Y - (CHARS_ROWS_LEN))) {
+    if ((x > s_width - (CHARS_COLS_LEN + 1)) &&
+            (y > s_height - (CHARS_ROWS_LEN))) {
         // out of range
         return false;
     }
     // check if x coordinates is out of range
     // and y is not out of range go to next line
-    if ((x > MAX_X - (CHARS_COLS_LEN + 1)) &&
-            (y < MAX_Y - (CHARS_ROWS_LEN))) {
+    if ((x > s_width - (CHARS_COLS_LEN + 1)) &&
+            (y < s_height - (CHARS_ROWS_LEN))) {
         // change position y
         s_cur_y = y + CHARS_ROWS_LEN;
         // change position x
@@ -475,108 +1134,195 @@ bool st7735_set_position(uint8_t x, uint8_t y)
 }
 
 
+/* Convert logical coordinates to GRAM addresses, for the current rotation */
+static void st7735_logical_to_lcd(int *x, int *y)
+{
+    *x += s_rotations[s_rotation].x_offset;
+    *y += s_rotations[s_rotation].y_offset;
+}
+
+void st7735_set_rotation(st7735_rotation_t rotation)
+{
+    if (rotation == s_rotation) {
+        return;
+    }
+    s_rotation = rotation;
+    s_width = s_rotations[rotation].width;
+    s_height = s_rotations[rotation].height;
+    s_lcd_win_valid = false;
+    if (s_spi_dev) {
+        // otherwise sent as a part of the init sequence
+        st7735_send_cmd(MADCTL, &s_rotations[rotation].madctl, 1);
+    }
+#if CONFIG_ST7735_FRAMEBUFFER
+    if (s_fb_busy) {
+        st7735_flush();
+    }
+    // contents are laid out for the previous rotation, has to be redrawn;
+    // regions marked so far may be outside of the screen now
+    st7735_fb_set_window(0, s_width - 1, 0, s_height - 1);
+    s_fb_dirty_count = 0;
+    st7735_fb_mark_dirty(0, s_width - 1, 0, s_height - 1);
+#endif
+}
+
+st7735_rotation_t st7735_get_rotation(void)
+{
+    return s_rotation;
+}
+
+uint8_t st7735_width(void)
+{
+    return s_width;
+}
+
+uint8_t st7735_height(void)
+{
+    return s_height;
+}
+
 void st7735_draw_pixel(uint8_t x, uint8_t y, uint16_t color)
 {
+#if CONFIG_ST7735_FRAMEBUFFER
+    // fast path, no need to go through the window
+    if (x < s_width && y < s_height) {
+        if (s_fb_busy) {
+            st7735_flush();
+        }
+        st7735_fb_put(x, y, &color, 0, 1);
+        st7735_fb_mark_dirty(x, x, y, y);
+    }
+#else
     // set window
     st7735_set_window(x, x, y, y);
     // draw pixel by 565 mode
     st7735_fill_color565(color, 1);
+#endif
 }
 
 
+/* Horizontal and vertical scaling factors of each font size */
+static int st7735_font_scale_x(ESizes size)
+{
+    return (size == X3) ? 2 : 1;
+}
+
+static int st7735_font_scale_y(ESizes size)
+{
+    return (size == X1) ? 1 : 2;
+}
+
+int st7735_char_advance(ESizes size)
+{
+    return CHARS_COLS_LEN + 1 + (size >> 1);
+}
+
+static const uint8_t *st7735_glyph(char character)
+{
+    // characters out of range are drawn as spaces
+    if ((uint8_t) character < 0x20 || (uint8_t) character > 0x7f) {
+        character = ' ';
+    }
+    return CHARACTERS[character - 32];
+}
+
 char st7735_draw_char(char character, uint16_t color, ESizes size)
 {
-    // variables
-    uint8_t letter, idxCol, idxRow;
     // check if character is out of range
-    if ((character < 0x20) &&
-            (character > 0x7f)) {
+    if (((uint8_t) character < 0x20) ||
+            ((uint8_t) character > 0x7f)) {
         // out of range
         return 0;
     }
-    // last column of character array - 5 columns
-    idxCol = CHARS_COLS_LEN;
-    // last row of character array - 8 rows / bits
-    idxRow = CHARS_ROWS_LEN;
-
-    // ----------------------------------------
-    // SIZE X1 - normal font: 1x high, 1x wide
-    // ----------------------------------------
-    if (size == X1) {
-        // loop through 5 bytes
-        while (idxCol--) {
-            // read from ROM memory
-            letter = *(&CHARACTERS[character - 32][idxCol]);
-            // loop through 8 bits
-            while (idxRow--) {
-                // check if bit set
-                if ((letter & 0x80) == 0x80) {
-                    // draw pixel
-                    st7735_draw_pixel(s_cur_x + idxCol, s_cur_y + idxRow, color);
-                }
-                // byte move to left / next bit
-                letter = letter << 1;
+    const uint8_t *glyph = st7735_glyph(character);
+    int sx = st7735_font_scale_x(size);
+    int sy = st7735_font_scale_y(size);
+    // each column is drawn as vertical runs of set pixels,
+    // one window per run rather than one per pixel
+    for (int col = 0; col < CHARS_COLS_LEN; ++col) {
+        uint8_t bits = glyph[col];
+        int row = 0;
+        while (bits) {
+            // skip unset bits
+            while (!(bits & 1)) {
+                bits >>= 1;
+                ++row;
             }
-            // fill index row again
-            idxRow = CHARS_ROWS_LEN;
-        }
-        // -----------------------------------------
-        // SIZE X2 - bigger font 2x higher, 1x wide
-        // -----------------------------------------
-    } else if (size == X2) {
-        // loop through 5 bytes
-        while (idxCol--) {
-            // read from ROM memory
-            letter = *(&CHARACTERS[character - 32][idxCol]);
-            // loop through 8 bits
-            while (idxRow--) {
-                // check if bit set
-                if ((letter & 0x80) == 0x80) {
-                    // draw first up pixel;
-                    // note: (idxRow << 1) - 2x multiplied
-                    st7735_draw_pixel(s_cur_x + idxCol, s_cur_y + (idxRow << 1), color);
-                    // draw second down pixel
-                    st7735_draw_pixel(s_cur_x + idxCol, s_cur_y + (idxRow << 1) + 1, color);
-                }
-                // byte move to left / next bit
-                letter = letter << 1;
+            int run_start = row;
+            while (bits & 1) {
+                bits >>= 1;
+                ++row;
             }
-            // fill index row again
-            idxRow = CHARS_ROWS_LEN;
-        }
-        // ------------------------------------------------
-        // SIZE X3 - the biggest font: 2x higher, 2x wider
-        // ------------------------------------------------
-    } else if (size == X3) {
-        // loop through 5 bytes
-        while (idxCol--) {
-            // read from ROM memory
-            letter = *(&CHARACTERS[character - 32][idxCol]);
-            // loop through 8 bits
-            while (idxRow--) {
-                // check if bit set
-                if ((letter & 0x80) == 0x80) {
-                    // draw first left up pixel;
-                    // note: (idxRow << 1) - 2x multiplied
-                    st7735_draw_pixel(s_cur_x + (idxCol << 1), s_cur_y + (idxRow << 1), color);
-                    // draw second left down pixel
-                    st7735_draw_pixel(s_cur_x + (idxCol << 1), s_cur_y + (idxRow << 1) + 1, color);
-                    // draw third right up pixel
-                    st7735_draw_pixel(s_cur_x + (idxCol << 1) + 1, s_cur_y + (idxRow << 1), color);
-                    // draw fourth right down pixel
-                    st7735_draw_pixel(s_cur_x + (idxCol << 1) + 1, s_cur_y + (idxRow << 1) + 1, color);
-                }
-                // byte move to left / next bit
-                letter = letter << 1;
+            int x = s_cur_x + col * sx;
+            if (st7735_set_window(x, x + sx - 1,
+                                  s_cur_y + run_start * sy, s_cur_y + row * sy - 1)) {
+                st7735_fill_color565(color, (row - run_start) * sx * sy);
             }
-            // fill index row again
-            idxRow = CHARS_ROWS_LEN;
         }
     }
     // return exit
     return 0;
 }
 
+/* Render one row of pixels of a text run (characters and gaps between them)
+ * starting at 'out'. Returns pointer past the last pixel written.
+ */
+static uint16_t *st7735_render_text_row(uint16_t *out, const char *str, int len, int row,
+                                        uint16_t color, uint16_t bg, ESizes size)
+{
+    int sx = st7735_font_scale_x(size);
+    int gap = st7735_char_advance(size) - CHARS_COLS_LEN * sx;
+    for (int i = 0; i < len; ++i) {
+        const uint8_t *glyph = st7735_glyph(str[i]);
+        for (int col = 0; col < CHARS_COLS_LEN; ++col) {
+            uint16_t c = ((glyph[col] >> row) & 1) ? color : bg;
+            for (int j = 0; j < sx; ++j) {
+                *out++ = c;
+            }
+        }
+        // no gap after the last character
+        if (i != len - 1) {
+            for (int j = 0; j < gap; ++j) {
+                *out++ = bg;
+            }
+        }
+    }
+    return out;
+}
+
+/* Draw 'len' characters with background as a single window */
+static void st7735_blit_text(const char *str, int len, uint16_t color, uint16_t bg, ESizes size)
+{
+    int sy = st7735_font_scale_y(size);
+    int glyph_width = CHARS_COLS_LEN * st7735_font_scale_x(size);
+    // no gap after the last character
+    int width = (len - 1) * st7735_char_advance(size) + glyph_width;
+    int height = CHARS_ROWS_LEN * sy;
+    if (len == 0 || width > ST7735_BAND_LEN ||
+            !st7735_set_window(s_cur_x, s_cur_x + width - 1, s_cur_y, s_cur_y + height - 1)) {
+        return;
+    }
+    st7735_write_start();
+    int rows_per_band = ST7735_BAND_LEN / width;
+    int y = 0;
+    while (y < height) {
+        int rows = MIN(rows_per_band, height - y);
+        uint16_t *band = st7735_band_get();
+        uint16_t *out = band;
+        for (int i = 0; i < rows; ++i) {
+            // rows are repeated for vertically scaled fonts
+            out = st7735_render_text_row(out, str, len, (y + i) / sy, color, bg, size);
+        }
+        st7735_band_send(out - band);
+        y += rows;
+    }
+}
+
+void st7735_draw_char_bg(char character, uint16_t color, uint16_t bg, ESizes size)
+{
+    st7735_blit_text(&character, 1, color, bg, size);
+}
+
 void st7735_draw_str(const char *str, uint16_t color, ESizes size)
 {
     // variables
@@ -590,135 +1336,635 @@ void st7735_draw_str(const char *str, uint16_t color, ESizes size)
     }
 }
 
-void st7735_draw_line(uint8_t x1, uint8_t x2, uint8_t y1, uint8_t y2, uint16_t color)
+void st7735_draw_str_bg(const char *str, uint16_t color, uint16_t bg, ESizes size)
 {
-    // determinant
-    int16_t D;
-    // deltas
-    int16_t delta_x, delta_y;
-    // steps
-    int16_t trace_x = 1, trace_y = 1;
+    int advance = st7735_char_advance(size);
+    int glyph_width = CHARS_COLS_LEN * st7735_font_scale_x(size);
+    // as many characters as fit on the line are sent as one window
+    int len = 0;
+    while (str[len] != '\0' && s_cur_x + len * advance + glyph_width <= s_width) {
+        ++len;
+    }
+    st7735_blit_text(str, len, color, bg, size);
+    st7735_set_position(s_cur_x + len * advance, s_cur_y);
+    // the rest follows st7735_draw_str line wrapping, one character at a time
+    for (str += len; *str != '\0'; ++str) {
+        st7735_draw_char_bg(*str, color, bg, size);
+        st7735_set_position(s_cur_x + advance, s_cur_y);
+    }
+}
+
+void st7735_fill_rect(int x0, int x1, int y0, int y1, uint16_t color)
+{
+    // clip to the visible area
+    x0 = MAX(x0, 0);
+    y0 = MAX(y0, 0);
+    x1 = MIN(x1, s_width - 1);
+    y1 = MIN(y1, s_height - 1);
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    st7735_set_window(x0, x1, y0, y1);
+    st7735_fill_color565(color, (x1 - x0 + 1) * (y1 - y0 + 1));
+}
+
+void st7735_draw_rect(int x0, int x1, int y0, int y1, uint16_t color)
+{
+    // top and bottom edges, then the sides between them
+    st7735_fill_rect(x0, x1, y0, y0, color);
+    if (y1 > y0) {
+        st7735_fill_rect(x0, x1, y1, y1, color);
+    }
+    if (y1 - y0 > 1) {
+        st7735_fill_rect(x0, x0, y0 + 1, y1 - 1, color);
+        if (x1 > x0) {
+            st7735_fill_rect(x1, x1, y0 + 1, y1 - 1, color);
+        }
+    }
+}
+
+/** @struct Source of the pixels of st7735_blit */
+typedef struct {
+    int width;                  // of the whole source, in pixels
+    const uint16_t *pixels;     // RGB565, or NULL for a bitmap
+    const uint8_t *bits;        // 1 bit per pixel, rows start at byte boundaries
+    st7735_qoi_t *qoi;          // compressed image, decoded in order
+    uint16_t fg;                // colors of set and clear bits
+    uint16_t bg;
+} st7735_blit_src_t;
 
-    // delta x
-    delta_x = x2 - x1;
-    // delta y
-    delta_y = y2 - y1;
+/* Write 'count' pixels of row 'y' of the source, starting at column 'x' */
+static void st7735_blit_row(uint16_t *out, const st7735_blit_src_t *src, int x, int y, int count)
+{
+    if (src->pixels) {
+        memcpy(out, &src->pixels[y * src->width + x], count * sizeof(uint16_t));
+        return;
+    }
+    if (src->qoi) {
+        // rows come in order; pixels which are not visible are skipped
+        st7735_qoi_decode(src->qoi, NULL, (uint32_t) y * src->width + x - src->qoi->pos);
+        st7735_qoi_decode(src->qoi, out, count);
+        return;
+    }
+    const uint8_t *row = &src->bits[y * ((src->width + 7) / 8)];
+    for (int i = x; i < x + count; ++i) {
+        *out++ = (row[i / 8] & (0x80 >> (i % 8))) ? src->fg : src->bg;
+    }
+}
 
-    // check if x2 > x1
-    if (delta_x < 0) {
-        // negate delta x
-        delta_x = -delta_x;
-        // negate step x
-        trace_x = -trace_x;
+/* Draw the visible part of a w x h source with the top left corner at x, y.
+ * The pixels are copied into band buffers before they are sent, so the source
+ * may be in memory-mapped flash, which can't be used for DMA.
+ */
+static void st7735_blit(int x, int y, int w, int h, const st7735_blit_src_t *src)
+{
+    // clip to the visible area
+    int x0 = MAX(x, 0);
+    int y0 = MAX(y, 0);
+    int x1 = MIN(x + w - 1, s_width - 1);
+    int y1 = MIN(y + h - 1, s_height - 1);
+    if (x0 > x1 || y0 > y1) {
+        return;
     }
+    st7735_set_window(x0, x1, y0, y1);
+    st7735_write_start();
+    int width = x1 - x0 + 1;
+    int rows_per_band = ST7735_BAND_LEN / width;
+    int row = y0;
+    while (row <= y1) {
+        int rows = MIN(rows_per_band, y1 - row + 1);
+        uint16_t *band = st7735_band_get();
+        for (int i = 0; i < rows; ++i) {
+            st7735_blit_row(&band[i * width], src, x0 - x, row + i - y, width);
+        }
+        st7735_band_send(rows * width);
+        row += rows;
+    }
+}
+
+void st7735_draw_image(int x, int y, int w, int h, const uint16_t *pixels)
+{
+    st7735_blit_src_t src = {
+        .width = w, .pixels = pixels
+    };
+    st7735_blit(x, y, w, h, &src);
+}
 
-    // check if y2 > y1
-    if (delta_y < 0) {
-        // negate detla y
-        delta_y = -delta_y;
-        // negate step y
-        trace_y = -trace_y;
+void st7735_draw_bitmap(int x, int y, int w, int h, const uint8_t *bits,
+                        uint16_t fg, uint16_t bg)
+{
+    st7735_blit_src_t src = {
+        .width = w, .bits = bits, .fg = fg, .bg = bg
+    };
+    st7735_blit(x, y, w, h, &src);
+}
+
+bool st7735_draw_qoi(int x, int y, const uint8_t *data, size_t size)
+{
+    st7735_qoi_t qoi;
+    if (!st7735_qoi_init(&qoi, data, size)) {
+        return false;
     }
+    st7735_blit_src_t src = {
+        .width = qoi.width, .qoi = &qoi
+    };
+    st7735_blit(x, y, qoi.width, qoi.height, &src);
+    return true;
+}
+
+void st7735_draw_line(uint8_t x1, uint8_t x2, uint8_t y1, uint8_t y2, uint16_t color)
+{
+    // Bresenham, but the pixels are drawn as runs along the major axis:
+    // each run ends when the minor coordinate changes, and is filled as
+    // a single window
+    int x = x1, y = y1;
+    // deltas
+    int delta_x = abs(x2 - x1);
+    int delta_y = abs(y2 - y1);
+    // steps
+    int trace_x = (x2 < x1) ? -1 : 1;
+    int trace_y = (y2 < y1) ? -1 : 1;
+    // determinant
+    int D;
+    // start of the current run
+    int start;
 
     // Bresenham condition for m < 1 (dy < dx)
     if (delta_y < delta_x) {
-        // calculate determinant
         D = (delta_y << 1) - delta_x;
-        // draw first pixel
-        st7735_draw_pixel(x1, y1, color);
-        // check if x1 equal x2
-        while (x1 != x2) {
-            // update x1
-            x1 += trace_x;
-            // check if determinant is positive
+        start = x;
+        while (x != x2) {
+            x += trace_x;
             if (D >= 0) {
-                // update y1
-                y1 += trace_y;
-                // update determinant
+                // y changes, the run ends at the previous pixel
+                st7735_fill_rect(MIN(start, x - trace_x), MAX(start, x - trace_x), y, y, color);
+                y += trace_y;
+                start = x;
                 D -= (delta_x << 1);
             }
-            // update deteminant
             D += (delta_y << 1);
-            // draw next pixel
-            st7735_draw_pixel(x1, y1, color);
         }
+        st7735_fill_rect(MIN(start, x), MAX(start, x), y, y, color);
         // for m > 1 (dy > dx)
     } else {
-        // calculate determinant
         D = delta_y - (delta_x << 1);
-        // draw first pixel
-        st7735_draw_pixel(x1, y1, color);
-        // check if y2 equal y1
-        while (y1 != y2) {
-            // update y1
-            y1 += trace_y;
-            // check if determinant is positive
+        start = y;
+        while (y != y2) {
+            y += trace_y;
             if (D <= 0) {
-                // update y1
-                x1 += trace_x;
-                // update determinant
+                // x changes, the run ends at the previous pixel
+                st7735_fill_rect(x, x, MIN(start, y - trace_y), MAX(start, y - trace_y), color);
+                x += trace_x;
+                start = y;
                 D += (delta_y << 1);
             }
-            // update deteminant
             D -= (delta_x << 1);
-            // draw next pixel
-            st7735_draw_pixel(x1, y1, color);
         }
+        st7735_fill_rect(x, x, MIN(start, y), MAX(start, y), color);
     }
 }
 
 void st7735_draw_line_h(uint8_t xs, uint8_t xe, uint8_t y, uint16_t color)
 {
-    uint8_t temp;
-    // check if start is > as end
-    if (xs > xe) {
-        // temporary safe
-        temp = xe;
-        // start change for end
-        xe = xs;
-        // end change for start
-        xs = temp;
-    }
-    // set window
-    st7735_set_window(xs, xe, y, y);
-    // draw pixel by 565 mode
-    st7735_fill_color565(color, xe - xs);
+    st7735_fill_rect(MIN(xs, xe), MAX(xs, xe), y, y, color);
 }
 
 void st7735_draw_line_v(uint8_t x, uint8_t ys, uint8_t ye, uint16_t color)
 {
-    uint8_t temp;
-    // check if start is > as end
-    if (ys > ye) {
-        // temporary safe
-        temp = ye;
-        // start change for end
-        ye = ys;
-        // end change for start
-        ys = temp;
-    }
-    // set window
-    st7735_set_window(x, x, ys, ye);
-    // draw pixel by 565 mode
-    st7735_fill_color565(color, ye - ys);
+    st7735_fill_rect(x, x, MIN(ys, ye), MAX(ys, ye), color);
 }
 
 void st7735_clear_screen(uint16_t color)
 {
-    // set whole window
-    st7735_set_window(0, MAX_X, MIN_Y, MAX_Y);
-    // draw individual pixels
-    // CACHE_SIZE_MEM = SIZE_X * SIZE_Y
-    st7735_fill_color565(color, CACHE_SIZE_MEM);
+#if CONFIG_ST7735_FB_PALETTE
+    // no pixel will refer to the colors added to the palette
+    st7735_palette_reset();
+#endif
+    // set whole visible window
+    st7735_set_window(0, s_width - 1, 0, s_height - 1);
+    // fill exactly the number of pixels in the window
+    st7735_fill_color565(color, s_width * s_height);
 }
 
 void st7735_update_screen(void)
 {
+#if CONFIG_ST7735_FRAMEBUFFER
+    // send modified regions of the framebuffer
+    st7735_fb_flush();
+#endif
+#if CONFIG_ST7735_FB_PALETTE
+    s_palette_collect_allowed = true;
+#endif
     // display on
     st7735_send_command(DISPON);
 }
 
-static void st7735_delay_ms(uint8_t ms)
+#if CONFIG_ST7735_FRAMEBUFFER
+
+static void st7735_fb_set_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1)
+{
+    s_fb_win = (st7735_rect_t) {
+        .x0 = x0, .x1 = x1, .y0 = y0, .y1 = y1
+    };
+    // like RAMWR, start writing from the top left corner of the window
+    s_fb_x = x0;
+    s_fb_y = y0;
+    s_fb_win_dirty = false;
+}
+
+/* Write 'count' pixels at the current position in the window. 'step' is 1
+ * to copy consecutive pixels, 0 to fill with the single color at 'pixels'.
+ */
+static void st7735_fb_write(const uint16_t *pixels, int step, int count)
 {
-    usleep(100 * ms); /* 10 times shorter delays also seem to work */
+    if (s_fb_busy) {
+        // previous update is still being sent from the framebuffer
+        st7735_flush();
+    }
+    if (!s_fb_win_dirty) {
+        // clip the window to the visible area
+        uint8_t x1 = MIN(s_fb_win.x1, s_width - 1);
+        uint8_t y1 = MIN(s_fb_win.y1, s_height - 1);
+        if (s_fb_win.x0 <= x1 && s_fb_win.y0 <= y1) {
+            st7735_fb_mark_dirty(s_fb_win.x0, x1, s_fb_win.y0, y1);
+        }
+        s_fb_win_dirty = true;
+    }
+    while (count > 0) {
+        // number of pixels until the end of the current window row
+        int run = MIN(count, s_fb_win.x1 - s_fb_x + 1);
+        // part of the run which is visible
+        int vis_end = MIN(s_fb_x + run, s_width);
+        if (s_fb_y < s_height && s_fb_x < vis_end) {
+            st7735_fb_put(s_fb_x, s_fb_y, pixels, step, vis_end - s_fb_x);
+        }
+        pixels += run * step;
+        count -= run;
+        s_fb_x += run;
+        if (s_fb_x > s_fb_win.x1) {
+            // wrap to the next row; after the last row, wrap to the first one
+            s_fb_x = s_fb_win.x0;
+            s_fb_y = (s_fb_y == s_fb_win.y1) ? s_fb_win.y0 : s_fb_y + 1;
+        }
+    }
+}
+
+#if CONFIG_ST7735_FB_PALETTE
+
+/* Squared distance between two colors, with all components scaled to 6 bits */
+static int st7735_color_distance(uint16_t a, uint16_t b)
+{
+    // colors are stored byte swapped
+    a = (a >> 8) | (a << 8);
+    b = (b >> 8) | (b << 8);
+    int d0 = ((a >> 11) - (b >> 11)) * 2;
+    int d1 = ((a >> 5) & 0x3f) - ((b >> 5) & 0x3f);
+    int d2 = ((a & 0x1f) - (b & 0x1f)) * 2;
+    return d0 * d0 + d1 * d1 + d2 * d2;
 }
+
+/* Mark the palette entries which no pixel refers to as free */
+static void st7735_palette_collect(void)
+{
+    bool used[FB_PALETTE_LEN] = {};
+    for (int i = 0; i < sizeof(s_fb); ++i) {
+#if CONFIG_ST7735_FB_8BPP
+        used[s_fb[i]] = true;
+#else
+        used[s_fb[i] >> 4] = true;
+        used[s_fb[i] & 0x0f] = true;
+#endif
+    }
+    for (int i = s_palette_fixed; i < s_palette_count; ++i) {
+        s_palette_free[i] = !used[i];
+    }
+    // cache entries may refer to the freed entries
+    s_palette_mru_color[0] = s_palette_mru_color[1] = s_palette[0];
+    s_palette_mru_index[0] = s_palette_mru_index[1] = 0;
+}
+
+/* Index for a color which is not in the palette yet, or -1 if it is full */
+static int st7735_palette_alloc(void)
+{
+    if (s_palette_count < FB_PALETTE_LEN) {
+        return s_palette_count++;
+    }
+    if (s_palette_collect_allowed) {
+        // at most once per update, as this reads the whole framebuffer
+        s_palette_collect_allowed = false;
+        st7735_palette_collect();
+    }
+    for (int i = s_palette_fixed; i < FB_PALETTE_LEN; ++i) {
+        if (s_palette_free[i]) {
+            s_palette_free[i] = false;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Drop the colors added since the palette was installed, when no pixel
+ * refers to them any more
+ */
+static void st7735_palette_reset(void)
+{
+    s_palette_count = s_palette_fixed;
+    memset(s_palette_free, 0, sizeof(s_palette_free));
+    s_palette_mru_color[0] = s_palette_mru_color[1] = s_palette[0];
+    s_palette_mru_index[0] = s_palette_mru_index[1] = 0;
+}
+
+/* Palette index of a color. Colors which are not in the palette are added
+ * while there is room, reusing the entries no longer drawn with; afterwards
+ * the nearest color is used.
+ */
+static uint8_t st7735_palette_index(uint16_t color)
+{
+    if (s_palette_mru_color[0] == color) {
+        return s_palette_mru_index[0];
+    }
+    int index;
+    if (s_palette_mru_color[1] == color) {
+        index = s_palette_mru_index[1];
+    } else {
+        int best_distance = INT32_MAX;
+        index = 0;
+        for (int i = 0; i < s_palette_count && best_distance > 0; ++i) {
+            if (s_palette_free[i]) {
+                continue;
+            }
+            int distance = st7735_color_distance(s_palette[i], color);
+            if (distance < best_distance) {
+                best_distance = distance;
+                index = i;
+            }
+        }
+        if (best_distance > 0) {
+            int new_index = st7735_palette_alloc();
+            if (new_index >= 0) {
+                index = new_index;
+                s_palette[index] = color;
+            }
+        }
+    }
+    s_palette_mru_color[1] = s_palette_mru_color[0];
+    s_palette_mru_index[1] = s_palette_mru_index[0];
+    s_palette_mru_color[0] = color;
+    s_palette_mru_index[0] = index;
+    return index;
+}
+
+void st7735_set_palette(const uint16_t *colors, size_t count)
+{
+    if (s_fb_busy) {
+        st7735_flush();
+    }
+    count = MIN(count, FB_PALETTE_LEN);
+    memcpy(s_palette, colors, count * sizeof(uint16_t));
+    s_palette_fixed = MAX(count, 1);
+    // cache entries may refer to the old palette
+    st7735_palette_reset();
+    // same indices mean different colors now
+    st7735_fb_mark_dirty(0, s_width - 1, 0, s_height - 1);
+}
+
+#endif // CONFIG_ST7735_FB_PALETTE
+
+/* Store 'count' pixels in a row of the framebuffer, starting at x, y.
+ * 'step' is 1 to copy consecutive pixels, 0 to repeat the pixel at 'pixels'.
+ */
+static void st7735_fb_put(int x, int y, const uint16_t *pixels, int step, int count)
+{
+    int offset = y * s_width + x;
+#if CONFIG_ST7735_FB_RGB565
+    uint16_t *p = &s_fb[offset];
+    for (int i = 0; i < count; ++i) {
+        *p++ = *pixels;
+        pixels += step;
+    }
+#elif CONFIG_ST7735_FB_8BPP
+    uint8_t *p = &s_fb[offset];
+    uint8_t index = st7735_palette_index(*pixels);
+    for (int i = 0; i < count; ++i) {
+        if (step) {
+            index = st7735_palette_index(*pixels);
+            pixels += step;
+        }
+        *p++ = index;
+    }
+#elif CONFIG_ST7735_FB_4BPP
+    uint8_t index = st7735_palette_index(*pixels);
+    for (int i = offset; i < offset + count; ++i) {
+        if (step) {
+            index = st7735_palette_index(*pixels);
+            pixels += step;
+        }
+        uint8_t *p = &s_fb[i / 2];
+        *p = (i & 1) ? ((*p & 0xf0) | index) : ((*p & 0x0f) | (index << 4));
+    }
+#endif
+}
+
+/* Read 'count' pixels in a row of the framebuffer, starting at x, y, as RGB565 */
+static void st7735_fb_get(uint16_t *out, int x, int y, int count)
+{
+    int offset = y * s_width + x;
+#if CONFIG_ST7735_FB_RGB565
+    memcpy(out, &s_fb[offset], count * sizeof(uint16_t));
+#elif CONFIG_ST7735_FB_8BPP
+    const uint8_t *p = &s_fb[offset];
+    for (int i = 0; i < count; ++i) {
+        out[i] = s_palette[p[i]];
+    }
+#elif CONFIG_ST7735_FB_4BPP
+    const uint8_t *p = &s_fb[offset / 2];
+    if (offset & 1) {
+        *out++ = s_palette[*p++ & 0x0f];
+        --count;
+    }
+    // two pixels per byte
+    for (; count >= 2; count -= 2) {
+        uint8_t b = *p++;
+        *out++ = s_palette[b >> 4];
+        *out++ = s_palette[b & 0x0f];
+    }
+    if (count) {
+        *out = s_palette[*p >> 4];
+    }
+#endif
+}
+
+static int st7735_rect_area(const st7735_rect_t *r)
+{
+    return (r->x1 - r->x0 + 1) * (r->y1 - r->y0 + 1);
+}
+
+static st7735_rect_t st7735_rect_union(const st7735_rect_t *a, const st7735_rect_t *b)
+{
+    return (st7735_rect_t) {
+        .x0 = MIN(a->x0, b->x0), .x1 = MAX(a->x1, b->x1),
+        .y0 = MIN(a->y0, b->y0), .y1 = MAX(a->y1, b->y1)
+    };
+}
+
+static bool st7735_rect_touches(const st7735_rect_t *a, const st7735_rect_t *b)
+{
+    // true if rectangles overlap or are adjacent
+    return a->x0 <= b->x1 + 1 && b->x0 <= a->x1 + 1 &&
+           a->y0 <= b->y1 + 1 && b->y0 <= a->y1 + 1;
+}
+
+static void st7735_fb_mark_dirty(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1)
+{
+    if (s_fb_restoring) {
+        // LCD already shows these pixels
+        return;
+    }
+    st7735_rect_t r = {
+        .x0 = x0, .x1 = x1, .y0 = y0, .y1 = y1
+    };
+    // grow an existing rectangle if the new one touches it;
+    // the grown rectangle may now touch others, so repeat
+    for (int i = 0; i < s_fb_dirty_count; ++i) {
+        if (st7735_rect_touches(&r, &s_fb_dirty[i])) {
+            r = st7735_rect_union(&r, &s_fb_dirty[i]);
+            s_fb_dirty[i] = s_fb_dirty[--s_fb_dirty_count];
+            i = -1;
+        }
+    }
+    if (s_fb_dirty_count < FB_DIRTY_RECTS_MAX) {
+        s_fb_dirty[s_fb_dirty_count++] = r;
+        return;
+    }
+    // out of slots: merge with the rectangle which grows the least
+    int best = 0;
+    int best_growth = INT32_MAX;
+    for (int i = 0; i < s_fb_dirty_count; ++i) {
+        st7735_rect_t u = st7735_rect_union(&r, &s_fb_dirty[i]);
+        int growth = st7735_rect_area(&u) - st7735_rect_area(&s_fb_dirty[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    s_fb_dirty[best] = st7735_rect_union(&r, &s_fb_dirty[best]);
+}
+
+void st7735_fb_restore_begin(void)
+{
+    s_fb_restoring = true;
+}
+
+void st7735_fb_restore_end(void)
+{
+    s_fb_restoring = false;
+}
+
+/* Blend 'fg' over 'bg', with 'alpha' from 0 (bg) to 32 (fg). The components
+ * are spread out in a 32-bit word (green in the upper half), with enough room
+ * between them to be blended together with a single multiplication.
+ */
+static inline uint16_t st7735_blend565(uint16_t fg, uint16_t bg, uint32_t alpha)
+{
+    // colors are stored byte swapped
+    fg = (fg >> 8) | (fg << 8);
+    bg = (bg >> 8) | (bg << 8);
+    uint32_t f = (fg | ((uint32_t) fg << 16)) & 0x07e0f81f;
+    uint32_t b = (bg | ((uint32_t) bg << 16)) & 0x07e0f81f;
+    uint32_t r = ((((f - b) * alpha) >> 5) + b) & 0x07e0f81f;
+    uint16_t v = r | (r >> 16);
+    return (v >> 8) | (v << 8);
+}
+
+void st7735_blend_span(int x, int y, const uint8_t *alpha, int count, uint16_t color)
+{
+    // clip to the visible area
+    if (y < 0 || y >= s_height) {
+        return;
+    }
+    if (x < 0) {
+        alpha -= x;
+        count += x;
+        x = 0;
+    }
+    count = MIN(count, s_width - x);
+    // pixels at the ends which are not covered are left alone
+    while (count > 0 && alpha[0] == 0) {
+        ++alpha;
+        ++x;
+        --count;
+    }
+    while (count > 0 && alpha[count - 1] == 0) {
+        --count;
+    }
+    if (count <= 0) {
+        return;
+    }
+    if (s_fb_busy) {
+        st7735_flush();
+    }
+    uint16_t row[PANEL_LONG];
+    st7735_fb_get(row, x, y, count);
+    for (int i = 0; i < count; ++i) {
+        if (alpha[i] >= 32) {
+            row[i] = color;
+        } else if (alpha[i] > 0) {
+            row[i] = st7735_blend565(color, row[i], alpha[i]);
+        }
+    }
+    st7735_fb_put(x, y, row, 1, count);
+    st7735_fb_mark_dirty(x, x + count - 1, y, y);
+}
+
+void st7735_dump_ppm(FILE *out)
+{
+    // plain (ASCII) PPM, so that it survives being printed to the console
+    fprintf(out, "P3\n%d %d\n31\n", s_width, s_height);
+    for (int y = 0; y < s_height; ++y) {
+        for (int x = 0; x < s_width; ++x) {
+            // pixels are stored in the order they are sent, i.e. big endian
+            uint16_t v;
+            st7735_fb_get(&v, x, y, 1);
+            v = (v >> 8) | (v << 8);
+            // MADCTL selects BGR order; green is scaled down to 5 bits
+            fprintf(out, "%d %d %d ", v & 0x1f, (v >> 6) & 0x1f, v >> 11);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static void st7735_fb_flush(void)
+{
+    for (int i = 0; i < s_fb_dirty_count; ++i) {
+        const st7735_rect_t *r = &s_fb_dirty[i];
+        int width = r->x1 - r->x0 + 1;
+
+#if CONFIG_ST7735_FB_RGB565
+        if (width == s_width) {
+            // full rows are contiguous in memory, send them in one go
+            const uint16_t *row = &s_fb[r->y0 * s_width];
+            st7735_lcd_write_window(r->x0, r->x1, r->y0, r->y1, row, width * (r->y1 - r->y0 + 1));
+            // framebuffer must not be modified until these transfers are done
+            s_fb_busy = true;
+            continue;
+        }
+#endif
+        // gather the rows into band buffers, converting them to RGB565
+        st7735_lcd_set_window(r->x0, r->x1, r->y0, r->y1);
+        st7735_send_command(RAMWR);
+        int rows_per_band = ST7735_BAND_LEN / width;
+        int y = r->y0;
+        while (y <= r->y1) {
+            int rows = MIN(rows_per_band, r->y1 - y + 1);
+            uint16_t *band = st7735_band_get();
+            for (int i = 0; i < rows; ++i) {
+                st7735_fb_get(&band[i * width], r->x0, y + i, width);
+            }
+            s_band_seq[s_band_idx] = st7735_send_pixels(band, rows * width);
+            y += rows;
+        }
+    }
+    s_fb_dirty_count = 0;
+}
+
+#endif // CONFIG_ST7735_FRAMEBUFFER
@@ -16,17 +16,92 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include "sdkconfig.h"
 #include "st7735_defs.h"
 
+/* Start the LCD init sequence. The delays it needs are done in the background,
+ * drawing functions can be called right away and wait for it when they have
+ * to use the bus. With 'warm' set, only wakes up the LCD (see st7735_init_warm).
+ */
+void st7735_init_start(bool warm);
+/* Wait for the sequence started by st7735_init_start to finish */
+void st7735_init_wait(void);
 void st7735_init(void);
+/* Initialize after st7735_sleep, if the LCD was kept powered and out of reset.
+ * Only wakes up the LCD, which still shows the contents of its memory.
+ */
+void st7735_init_warm(void);
+/* Put the LCD into sleep mode. It keeps its memory and settings. */
+void st7735_sleep(void);
+/* Idle mode: the LCD shows only 8 colors (the top bit of each component)
+ * and uses less power. Memory contents are kept as they are.
+ */
+void st7735_set_idle_mode(bool enable);
+
+/** @enum Screen rotation, clockwise */
+typedef enum {
+    ST7735_ROTATION_0,      // landscape, 160 x 80
+    ST7735_ROTATION_90,     // portrait, 80 x 160
+    ST7735_ROTATION_180,
+    ST7735_ROTATION_270,
+} st7735_rotation_t;
+
+/* Set the orientation of the screen, done by the LCD itself (MADCTL).
+ * Can be called before st7735_init. All coordinates are logical, with
+ * (0, 0) at the top left corner of the visible area in this orientation.
+ * What is already shown isn't rotated, redraw it after changing the rotation.
+ */
+void st7735_set_rotation(st7735_rotation_t rotation);
+st7735_rotation_t st7735_get_rotation(void);
+/* Size of the screen, in the current orientation */
+uint8_t st7735_width(void);
+uint8_t st7735_height(void);
 
 uint8_t st7735_set_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1);
+/* Set the window and write 'count' RGB565 pixels into it, as a single RAMWR.
+ * Unless the framebuffer is used, 'pixels' must stay valid until st7735_flush.
+ */
+bool st7735_write_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1,
+                         const uint16_t *pixels, size_t count);
 bool st7735_set_position(uint8_t x, uint8_t y);
 
 void st7735_draw_pixel(uint8_t x, uint8_t y, uint16_t color);
 char st7735_draw_char(char c, uint16_t color, ESizes size);
 void st7735_draw_str(const char *str, uint16_t color, ESizes size);
+/* Same as above, but also fill the character cells with 'bg' color.
+ * Much faster since every character (or string) is sent as a single window.
+ */
+void st7735_draw_char_bg(char c, uint16_t color, uint16_t bg, ESizes size);
+void st7735_draw_str_bg(const char *str, uint16_t color, uint16_t bg, ESizes size);
+/* Distance between the start positions of two consecutive characters */
+int st7735_char_advance(ESizes size);
 
+/* Fill a rectangle, or draw its outline. Coordinates are inclusive and
+ * may be outside of the screen; only the visible part is drawn.
+ */
+void st7735_fill_rect(int x0, int x1, int y0, int y1, uint16_t color);
+void st7735_draw_rect(int x0, int x1, int y0, int y1, uint16_t color);
+
+/* Draw a w x h image with the top left corner at x, y; it may be partly
+ * outside of the screen. Pixels are RGB565, in the byte order they are sent
+ * to the LCD. Image data is copied before sending, so it can be anywhere,
+ * including flash mapped with esp_partition_mmap.
+ */
+void st7735_draw_image(int x, int y, int w, int h, const uint16_t *pixels);
+/* Same for a bitmap of 1 bit per pixel, drawn with 'fg' for set bits and 'bg'
+ * for clear bits. Each row starts at a byte boundary, MSB is the leftmost pixel.
+ */
+void st7735_draw_bitmap(int x, int y, int w, int h, const uint8_t *bits,
+                        uint16_t fg, uint16_t bg);
+/* Draw an image compressed with QOI, with the top left corner at x, y.
+ * It is decoded one band at a time while the previous band is being sent, so
+ * RAM use doesn't depend on the size of the image. Returns false if 'data'
+ * isn't a QOI image.
+ */
+bool st7735_draw_qoi(int x, int y, const uint8_t *data, size_t size);
+
+/* Lines are drawn as horizontal or vertical runs, each one a single window */
 void st7735_draw_line(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1, uint16_t color);
 void st7735_draw_line_h(uint8_t x0, uint8_t x1, uint8_t y, uint16_t color);
 void st7735_draw_line_v(uint8_t x, uint8_t y0, uint8_t y1, uint16_t color);
@@ -34,6 +109,73 @@ void st7735_draw_line_v(uint8_t x, uint8_t y0, uint8_t y1, uint16_t color);
 void st7735_clear_screen(uint16_t color);
 void st7735_update_screen(void);
 
+/* Transfers to the LCD are queued and sent using DMA in the background.
+ * st7735_flush waits until all queued transfers are finished.
+ */
+void st7735_flush(void);
+
+/* Counters of SPI traffic to the LCD, e.g. to measure the cost of an operation */
+typedef struct {
+    uint32_t transactions;  // number of SPI transactions
+    uint32_t commands;      // transactions with D/C = 0
+    uint32_t bytes;         // bytes sent
+    uint32_t bus_time_us;   // time to send these bytes at the configured clock
+} st7735_stats_t;
+
+void st7735_get_stats(st7735_stats_t *out);
+void st7735_reset_stats(void);
+
+#if CONFIG_ST7735_FRAMEBUFFER
+/* Write framebuffer contents as a PPM image, with colors as shown by the LCD */
+void st7735_dump_ppm(FILE *out);
+
+/* Drawing between these calls only updates the framebuffer and doesn't
+ * send anything to the LCD. Used to recreate the framebuffer contents after
+ * st7735_init_warm, when the LCD memory is intact but the framebuffer isn't.
+ */
+void st7735_fb_restore_begin(void);
+void st7735_fb_restore_end(void);
+
+/* Blend 'color' into 'count' pixels of row 'y' starting at 'x', each one with
+ * the coverage in 'alpha', from 0 (pixel is kept) to 32 (pixel is replaced).
+ * Pixels outside of the screen are skipped.
+ */
+void st7735_blend_span(int x, int y, const uint8_t *alpha, int count, uint16_t color);
+
+/* Anti-aliased drawing, into the framebuffer. Coordinates and sizes are in
+ * 1/ST7735_AA_ONE pixel, with integer coordinates at pixel centers; they may
+ * be outside of the screen by up to one screen size.
+ * Angles are in 1/ST7735_AA_TURN of a turn, clockwise from 12 o'clock.
+ * With a palette framebuffer, blended edges take up palette entries.
+ */
+#define ST7735_AA_ONE   16
+#define ST7735_AA_TURN  720
+
+/* Sine and cosine of an angle, scaled by 2^14 */
+int st7735_aa_sin(int angle);
+int st7735_aa_cos(int angle);
+/* Point at 'radius' from (cx, cy) in the direction of 'angle' */
+void st7735_aa_polar(int cx, int cy, int radius, int angle, int *x, int *y);
+
+/* Line of the given width with round ends */
+void st7735_aa_line(int x0, int y0, int x1, int y1, int width, uint16_t color);
+/* Circle outline of the given width, centered on radius 'r' */
+void st7735_aa_circle(int cx, int cy, int r, int width, uint16_t color);
+void st7735_aa_fill_circle(int cx, int cy, int r, uint16_t color);
+/* Part of a circle outline, clockwise from angle 'start' to 'end' */
+void st7735_aa_arc(int cx, int cy, int r, int width, int start, int end, uint16_t color);
+#endif
+
+#if CONFIG_ST7735_FB_PALETTE
+/* Replace the palette of the framebuffer, e.g. with the colors of a screen,
+ * and redraw the whole LCD on the next update. Colors drawn which are not in
+ * the palette are added to it while there is room, reusing the entries no
+ * pixel is drawn with any more; afterwards the nearest palette color is used.
+ * Clearing the screen drops the added colors, these entries are kept.
+ */
+void st7735_set_palette(const uint16_t *colors, size_t count);
+#endif
+
 
 #ifdef __cplusplus
 }
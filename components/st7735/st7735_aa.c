@@ -0,0 +1,302 @@
+/**
+ * Anti-aliased drawing into the framebuffer of the ST7735 driver
+ *
+ * Copyright (c) 2020 Ivan Grokhotkov
+ * Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/param.h>
+#include "sdkconfig.h"
+#include "st7735.h"
+
+#if CONFIG_ST7735_FRAMEBUFFER
+
+// Internally, positions and distances are fixed point with 8 fractional bits
+#define FRAC_BITS   8
+#define FRAC_ONE    (1 << FRAC_BITS)
+#define HALF        (FRAC_ONE / 2)
+#define TO_FRAC(v)  ((v) * (FRAC_ONE / ST7735_AA_ONE))
+// and directions are unit vectors with 12 fractional bits
+#define DIR_BITS    12
+// longest row which can be drawn, as coordinates are uint8_t
+#define ROW_MAX     256
+
+/** @struct Part of a circle between two directions, clockwise */
+typedef struct {
+    int sx, sy;     // direction of the start
+    int ex, ey;     // direction of the end
+    bool wide;      // more than half a turn
+} aa_sector_t;
+
+/* Sine of angles of the first quarter of a turn, scaled by 2^14 */
+static const int16_t s_sin_table[ST7735_AA_TURN / 4 + 1] = {
+        0,   143,   286,   429,   572,   715,   857,  1000,  1143,  1285,
+     1428,  1570,  1713,  1855,  1997,  2139,  2280,  2422,  2563,  2704,
+     2845,  2986,  3126,  3266,  3406,  3546,  3686,  3825,  3964,  4102,
+     4240,  4378,  4516,  4653,  4790,  4927,  5063,  5199,  5334,  5469,
+     5604,  5738,  5872,  6005,  6138,  6270,  6402,  6533,  6664,  6794,
+     6924,  7053,  7182,  7311,  7438,  7565,  7692,  7818,  7943,  8068,
+     8192,  8316,  8438,  8561,  8682,  8803,  8923,  9043,  9162,  9280,
+     9397,  9514,  9630,  9746,  9860,  9974, 10087, 10199, 10311, 10422,
+    10531, 10641, 10749, 10856, 10963, 11069, 11174, 11278, 11381, 11484,
+    11585, 11686, 11786, 11885, 11982, 12080, 12176, 12271, 12365, 12458,
+    12551, 12642, 12733, 12822, 12911, 12998, 13085, 13170, 13255, 13338,
+    13421, 13502, 13583, 13662, 13741, 13818, 13894, 13970, 14044, 14117,
+    14189, 14260, 14330, 14399, 14466, 14533, 14598, 14663, 14726, 14788,
+    14849, 14909, 14968, 15025, 15082, 15137, 15191, 15244, 15296, 15346,
+    15396, 15444, 15491, 15537, 15582, 15626, 15668, 15709, 15749, 15788,
+    15826, 15862, 15897, 15931, 15964, 15996, 16026, 16055, 16083, 16110,
+    16135, 16159, 16182, 16204, 16225, 16244, 16262, 16279, 16294, 16309,
+    16322, 16333, 16344, 16353, 16362, 16368, 16374, 16378, 16382, 16383,
+    16384,
+};
+
+int st7735_aa_sin(int angle)
+{
+    const int quarter = ST7735_AA_TURN / 4;
+    angle %= ST7735_AA_TURN;
+    if (angle < 0) {
+        angle += ST7735_AA_TURN;
+    }
+    int a = angle % quarter;
+    switch (angle / quarter) {
+    case 0:
+        return s_sin_table[a];
+    case 1:
+        return s_sin_table[quarter - a];
+    case 2:
+        return -s_sin_table[a];
+    default:
+        return -s_sin_table[quarter - a];
+    }
+}
+
+int st7735_aa_cos(int angle)
+{
+    return st7735_aa_sin(angle + ST7735_AA_TURN / 4);
+}
+
+void st7735_aa_polar(int cx, int cy, int radius, int angle, int *x, int *y)
+{
+    // 12 o'clock is up, towards smaller y
+    *x = cx + ((radius * st7735_aa_sin(angle)) >> 14);
+    *y = cy - ((radius * st7735_aa_cos(angle)) >> 14);
+}
+
+/* Square root, rounded down */
+static uint32_t aa_isqrt(uint32_t v)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+/* Square of a distance; unsigned, as it may not fit into an int */
+static inline uint32_t aa_sq(int v)
+{
+    return (uint32_t) v * (uint32_t) v;
+}
+
+/* First and last pixel with the center in the range [lo, hi] */
+static inline int frac_ceil(int lo)
+{
+    return (lo + FRAC_ONE - 1) >> FRAC_BITS;
+}
+
+static inline int frac_floor(int hi)
+{
+    return hi >> FRAC_BITS;
+}
+
+/* Alpha for st7735_blend_span from the covered part of a pixel */
+static inline uint8_t aa_alpha(int coverage)
+{
+    coverage = MAX(0, MIN(coverage, FRAC_ONE));
+    return (coverage + (1 << (FRAC_BITS - 6))) >> (FRAC_BITS - 5);
+}
+
+void st7735_aa_line(int x0, int y0, int x1, int y1, int width, uint16_t color)
+{
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+    int len = aa_isqrt(aa_sq(dx) + aa_sq(dy));
+    if (len == 0) {
+        st7735_aa_fill_circle(x0, y0, width / 2, color);
+        return;
+    }
+    // unit vector along the line
+    int ux = dx * (1 << DIR_BITS) / len;
+    int uy = dy * (1 << DIR_BITS) / len;
+    int ax = TO_FRAC(x0);
+    int ay = TO_FRAC(y0);
+    int bx = TO_FRAC(x1);
+    int by = TO_FRAC(y1);
+    len = TO_FRAC(len);
+    // distance from the line at which pixels are no longer covered
+    int reach = TO_FRAC(width) / 2 + HALF;
+
+    int ys = MAX(frac_ceil(MIN(ay, by) - reach), 0);
+    int ye = MIN(frac_floor(MAX(ay, by) + reach), st7735_height() - 1);
+    int box_xs = MAX(frac_ceil(MIN(ax, bx) - reach), 0);
+    int box_xe = MIN(frac_floor(MAX(ax, bx) + reach), st7735_width() - 1);
+    uint8_t alpha[ROW_MAX];
+    for (int y = ys; y <= ye; ++y) {
+        int py = (y << FRAC_BITS) - ay;
+        int xs = box_xs;
+        int xe = box_xe;
+        if (uy != 0) {
+            // part of the row within 'reach' of the line through both ends,
+            // |px * uy - py * ux| <= reach, which contains the round ends too
+            int lo = (py * ux - (reach << DIR_BITS)) / uy;
+            int hi = (py * ux + (reach << DIR_BITS)) / uy;
+            xs = MAX(xs, frac_ceil(ax + MIN(lo, hi)));
+            xe = MIN(xe, frac_floor(ax + MAX(lo, hi)));
+        }
+        for (int x = xs; x <= xe; ++x) {
+            int px = (x << FRAC_BITS) - ax;
+            // position along the line, and distance from it
+            int t = (px * ux + py * uy) >> DIR_BITS;
+            int d;
+            if (t < 0) {
+                d = aa_isqrt(aa_sq(px) + aa_sq(py));
+            } else if (t > len) {
+                int qx = (x << FRAC_BITS) - bx;
+                int qy = (y << FRAC_BITS) - by;
+                d = aa_isqrt(aa_sq(qx) + aa_sq(qy));
+            } else {
+                d = abs(px * uy - py * ux) >> DIR_BITS;
+            }
+            alpha[x - xs] = aa_alpha(reach - d);
+        }
+        st7735_blend_span(xs, y, alpha, xe - xs + 1, color);
+    }
+}
+
+/* Coverage of a pixel at (px, py) from the center by a sector, with the edges
+ * anti-aliased like lines through the center.
+ */
+static int aa_sector_coverage(const aa_sector_t *sector, int px, int py)
+{
+    // signed distances from the edges, positive on the inner side
+    int ds = (sector->sx * py - sector->sy * px) >> DIR_BITS;
+    int de = (sector->ey * px - sector->ex * py) >> DIR_BITS;
+    int cs = MAX(0, MIN(ds + HALF, FRAC_ONE));
+    int ce = MAX(0, MIN(de + HALF, FRAC_ONE));
+    // up to half a turn, the sector is on the inner side of both edges
+    return sector->wide ? MAX(cs, ce) : MIN(cs, ce);
+}
+
+/* Draw pixels x0..x1 of a row of a ring. 'py' is the row relative to the
+ * center; 'inner' is negative if the ring has no hole.
+ */
+static void aa_ring_span(int x0, int x1, int y, int cx, int py, int outer, int inner,
+                         const aa_sector_t *sector, uint16_t color)
+{
+    uint8_t alpha[ROW_MAX];
+    for (int x = x0; x <= x1; ++x) {
+        int px = (x << FRAC_BITS) - cx;
+        int d = aa_isqrt(aa_sq(px) + aa_sq(py));
+        int coverage = MIN(outer - d, FRAC_ONE);
+        if (inner >= 0) {
+            coverage = MIN(coverage, d - inner);
+        }
+        if (sector && coverage > 0) {
+            coverage = (coverage * aa_sector_coverage(sector, px, py)) >> FRAC_BITS;
+        }
+        alpha[x - x0] = aa_alpha(coverage);
+    }
+    st7735_blend_span(x0, y, alpha, x1 - x0 + 1, color);
+}
+
+/* Ring between radii r_in and r_out; r_in of 0 fills the whole circle.
+ * Only the part in 'sector' is drawn, unless it is NULL.
+ */
+static void aa_ring(int cx, int cy, int r_out, int r_in, const aa_sector_t *sector,
+                    uint16_t color)
+{
+    cx = TO_FRAC(cx);
+    cy = TO_FRAC(cy);
+    // coverage falls from one to zero within half a pixel of the edges
+    int outer = TO_FRAC(r_out) + HALF;
+    int inner = (r_in > 0) ? TO_FRAC(r_in) - HALF : -1;
+
+    int ys = MAX(frac_ceil(cy - outer), 0);
+    int ye = MIN(frac_floor(cy + outer), st7735_height() - 1);
+    int width = st7735_width();
+    for (int y = ys; y <= ye; ++y) {
+        int py = (y << FRAC_BITS) - cy;
+        uint32_t py2 = aa_sq(py);
+        if (py2 >= aa_sq(outer)) {
+            continue;
+        }
+        int half = aa_isqrt(aa_sq(outer) - py2);
+        int xs = MAX(frac_ceil(cx - half), 0);
+        int xe = MIN(frac_floor(cx + half), width - 1);
+        if (inner > 0 && py2 < aa_sq(inner)) {
+            // skip the pixels in the hole
+            int hole = aa_isqrt(aa_sq(inner) - py2);
+            int left = MIN(frac_floor(cx - hole), xe);
+            int right = MAX(frac_ceil(cx + hole), xs);
+            if (xs <= left) {
+                aa_ring_span(xs, left, y, cx, py, outer, inner, sector, color);
+            }
+            if (right <= xe) {
+                aa_ring_span(right, xe, y, cx, py, outer, inner, sector, color);
+            }
+        } else if (xs <= xe) {
+            aa_ring_span(xs, xe, y, cx, py, outer, inner, sector, color);
+        }
+    }
+}
+
+void st7735_aa_circle(int cx, int cy, int r, int width, uint16_t color)
+{
+    aa_ring(cx, cy, r + width / 2, MAX(r - width / 2, 0), NULL, color);
+}
+
+void st7735_aa_fill_circle(int cx, int cy, int r, uint16_t color)
+{
+    aa_ring(cx, cy, r, 0, NULL, color);
+}
+
+void st7735_aa_arc(int cx, int cy, int r, int width, int start, int end, uint16_t color)
+{
+    int sweep = end - start;
+    if (sweep >= ST7735_AA_TURN) {
+        st7735_aa_circle(cx, cy, r, width, color);
+        return;
+    }
+    sweep %= ST7735_AA_TURN;
+    if (sweep < 0) {
+        sweep += ST7735_AA_TURN;
+    }
+    if (sweep == 0) {
+        return;
+    }
+    // directions on the screen, where 12 o'clock is towards smaller y
+    const int shift = 14 - DIR_BITS;
+    aa_sector_t sector = {
+        .sx = st7735_aa_sin(start) >> shift,
+        .sy = -st7735_aa_cos(start) >> shift,
+        .ex = st7735_aa_sin(end) >> shift,
+        .ey = -st7735_aa_cos(end) >> shift,
+        .wide = sweep > ST7735_AA_TURN / 2,
+    };
+    aa_ring(cx, cy, r + width / 2, MAX(r - width / 2, 0), &sector, color);
+}
+
+#endif // CONFIG_ST7735_FRAMEBUFFER
@@ -10,6 +10,8 @@
 
 
 #define DELAY   0x80
+// command in an init list which only sets the value the LCD has after reset
+#define RESET_DEFAULT 0x40
 
 #define NOP     0x00
 #define SWRESET 0x01
@@ -32,6 +34,8 @@
 
 #define PTLAR   0x30
 #define MADCTL  0x36
+#define IDMOFF  0x38
+#define IDMON   0x39
 #define COLMOD  0x3A
 
 #define FRMCTR1 0xB1
@@ -0,0 +1,128 @@
+/**
+ * Streaming decoder of QOI images for the ST7735 driver
+ *
+ * Copyright (c) 2020 Ivan Grokhotkov
+ * Distributed under MIT license as displayed in LICENSE file.
+ *
+ * QOI format specification: https://qoiformat.org/qoi-specification.pdf
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "st7735_qoi.h"
+
+#define QOI_HEADER_LEN  14
+#define QOI_END_LEN     8   // 7 zero bytes and a one
+
+#define QOI_OP_INDEX    0x00
+#define QOI_OP_DIFF     0x40
+#define QOI_OP_LUMA     0x80
+#define QOI_OP_RUN      0xc0
+#define QOI_OP_RGB      0xfe
+#define QOI_OP_RGBA     0xff
+#define QOI_MASK_2      0xc0
+
+static uint32_t qoi_read32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint16_t qoi_to_565(const uint8_t *px)
+{
+    // the LCD is in BGR mode, blue goes into the upper bits
+    uint16_t v = ((px[2] >> 3) << 11) | ((px[1] >> 2) << 5) | (px[0] >> 3);
+    return (v >> 8) | (v << 8);
+}
+
+bool st7735_qoi_init(st7735_qoi_t *qoi, const uint8_t *data, size_t size)
+{
+    if (size < QOI_HEADER_LEN + QOI_END_LEN || memcmp(data, "qoif", 4) != 0) {
+        return false;
+    }
+    memset(qoi, 0, sizeof(*qoi));
+    qoi->width = qoi_read32(data + 4);
+    qoi->height = qoi_read32(data + 8);
+    // pixel positions have to fit into 32 bits
+    if (qoi->width == 0 || qoi->height == 0 || qoi->width > UINT16_MAX || qoi->height > UINT16_MAX) {
+        return false;
+    }
+    qoi->data = data + QOI_HEADER_LEN;
+    qoi->end = data + size - QOI_END_LEN;
+    qoi->px[3] = 255;
+    qoi->px565 = qoi_to_565(qoi->px);
+    return true;
+}
+
+/* Decode the next chunk into the current pixel */
+static void qoi_next(st7735_qoi_t *qoi)
+{
+    const uint8_t *p = qoi->data;
+    uint8_t *px = qoi->px;
+    uint8_t op = *p++;
+    // number of bytes which follow the first one
+    int len = (op == QOI_OP_RGB) ? 3 : (op == QOI_OP_RGBA) ? 4 :
+              ((op & QOI_MASK_2) == QOI_OP_LUMA) ? 1 : 0;
+    if (qoi->end - p < len) {
+        // truncated, the last pixel is repeated
+        qoi->data = qoi->end;
+        return;
+    }
+    qoi->data = p + len;
+
+    if (op == QOI_OP_RGB || op == QOI_OP_RGBA) {
+        memcpy(px, p, len);
+    } else {
+        switch (op & QOI_MASK_2) {
+        case QOI_OP_INDEX:
+            memcpy(px, qoi->index[op], 4);
+            qoi->px565 = qoi->index565[op];
+            return;
+        case QOI_OP_DIFF:
+            px[0] += ((op >> 4) & 3) - 2;
+            px[1] += ((op >> 2) & 3) - 2;
+            px[2] += (op & 3) - 2;
+            break;
+        case QOI_OP_LUMA: {
+            int dg = (op & 0x3f) - 32;
+            px[0] += dg - 8 + (p[0] >> 4);
+            px[1] += dg;
+            px[2] += dg - 8 + (p[0] & 0x0f);
+            break;
+        }
+        case QOI_OP_RUN:
+            // this pixel, and as many more as the run says
+            qoi->run = op & 0x3f;
+            return;
+        }
+    }
+    qoi->px565 = qoi_to_565(px);
+    int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+    memcpy(qoi->index[hash], px, 4);
+    qoi->index565[hash] = qoi->px565;
+}
+
+void st7735_qoi_decode(st7735_qoi_t *qoi, uint16_t *out, int count)
+{
+    qoi->pos += count;
+    while (count > 0) {
+        if (qoi->run > 0) {
+            // runs are the common case for flat areas, write them in one go
+            int n = MIN(qoi->run, count);
+            if (out) {
+                for (int i = 0; i < n; ++i) {
+                    *out++ = qoi->px565;
+                }
+            }
+            qoi->run -= n;
+            count -= n;
+            continue;
+        }
+        if (qoi->data < qoi->end) {
+            qoi_next(qoi);
+        }
+        if (out) {
+            *out++ = qoi->px565;
+        }
+        --count;
+    }
+}
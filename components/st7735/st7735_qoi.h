@@ -0,0 +1,46 @@
+/**
+ * Streaming decoder of QOI images for the ST7735 driver
+ *
+ * Copyright (c) 2020 Ivan Grokhotkov
+ * Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Decoder state, enough to decode the pixels in order without keeping any
+ * of them; the whole image is never held in RAM.
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pos;               // number of pixels decoded so far
+    const uint8_t *data;        // next chunk
+    const uint8_t *end;         // end of the chunks
+    uint8_t px[4];              // last pixel, RGBA
+    uint16_t px565;             // same, as sent to the LCD
+    int run;                    // number of times it still has to be repeated
+    uint8_t index[64][4];       // recently seen pixels
+    uint16_t index565[64];
+} st7735_qoi_t;
+
+/* Check the header and prepare to decode. Returns false if 'data' isn't a
+ * QOI image.
+ */
+bool st7735_qoi_init(st7735_qoi_t *qoi, const uint8_t *data, size_t size);
+
+/* Decode the next 'count' pixels as RGB565, in the byte order they are sent
+ * to the LCD. With 'out' set to NULL, the pixels are skipped. Pixels past the
+ * end of damaged data are repeated from the last one.
+ */
+void st7735_qoi_decode(st7735_qoi_t *qoi, uint16_t *out, int count);
+
+#ifdef __cplusplus
+}
+#endif
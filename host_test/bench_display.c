@@ -0,0 +1,41 @@
+/**
+ *  Display benchmark on the emulated LCD.
+ *
+ *  Runs the benchmark of the firmware (main/display_bench.c) with the LCD
+ *  emulated on the host. Times are host CPU times, which show how much
+ *  drawing costs relative to the other cases; bus times are what the
+ *  transfers take at the configured SPI clock.
+ *
+ *  Usage: bench_display [iterations]
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "display.h"
+#include "display_bench.h"
+#include "lcd_emu.h"
+
+int main(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 100;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    emu_lcd_reset();
+    display_init();
+    display_wait_ready();
+    display_benchmark(iterations);
+
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    if (stats.errors != 0 || stats.hidden_pixels != 0) {
+        fprintf(stderr, "%u SPI errors, %u pixels written outside of the panel\n",
+                (unsigned) stats.errors, (unsigned) stats.hidden_pixels);
+        return 1;
+    }
+    return 0;
+}
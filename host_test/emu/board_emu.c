@@ -0,0 +1,101 @@
+/**
+ *  Emulated T-Wristband board, for the host tests of the application.
+ *
+ *  Implements main/board.h: the RTC is set up on the emulated I2C bus as
+ *  board.c does, the rest only records what the application asked for.
+ *  Touches are made by the test, and posted as the interrupt handler does
+ *  when the touchpad is released. board_sleep blocks the calling task for
+ *  good, as deep sleep ends the program.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "i2c_bus.h"
+#include "pcf8563.h"
+#include "board.h"
+#include "board_emu.h"
+
+static board_config_t s_config;
+static int s_brightness;
+static int64_t s_backlight_on_us = -1;
+static int64_t s_sleep_us = -1;
+
+ESP_EVENT_DEFINE_BASE(BOARD_EVENT);
+
+void board_init(const board_config_t *config)
+{
+    s_config = *config;
+}
+
+void board_touchpad_enable(void)
+{
+}
+
+void board_lcd_enable(void)
+{
+}
+
+void board_lcd_backlight(bool enable)
+{
+    board_lcd_brightness(enable ? 100 : 0);
+}
+
+void board_lcd_brightness(int percent)
+{
+    if (percent > 0 && s_backlight_on_us < 0) {
+        s_backlight_on_us = esp_timer_get_time();
+    }
+    s_brightness = percent;
+}
+
+void board_touchpad_light_sleep_wakeup(bool enable)
+{
+}
+
+void board_rtc_init(void)
+{
+    ESP_ERROR_CHECK(i2c_bus_init(I2C_NUM_0, I2C_SDA_PIN, I2C_SCL_PIN, 400000));
+    pcf8563_init(I2C_NUM_0);
+}
+
+void board_rtc_interrupt_enable(bool enable)
+{
+}
+
+void board_sleep(void)
+{
+    s_sleep_us = esp_timer_get_time();
+    SemaphoreHandle_t never = xSemaphoreCreateBinary();
+    xSemaphoreTake(never, portMAX_DELAY);
+}
+
+int64_t emu_board_touch(int hold_ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(hold_ms));
+    int event_id = hold_ms >= s_config.touchpad_long_press_threshold_ms ?
+                   TOUCHPAD_LONG_PRESS : TOUCHPAD_PRESS;
+    int64_t release_us = esp_timer_get_time();
+    BaseType_t task_unblocked;
+    ESP_ERROR_CHECK(esp_event_isr_post(BOARD_EVENT, event_id, NULL, 0, &task_unblocked));
+    return release_us;
+}
+
+int emu_board_brightness(void)
+{
+    return s_brightness;
+}
+
+int64_t emu_board_backlight_on_us(void)
+{
+    return s_backlight_on_us;
+}
+
+int64_t emu_board_sleep_us(void)
+{
+    return s_sleep_us;
+}
@@ -0,0 +1,20 @@
+/**
+ *  Emulated T-Wristband board, for the host tests of the application.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hold the touchpad for 'hold_ms' and release it; returns the time of the
+// release, when the board posts TOUCHPAD_PRESS or TOUCHPAD_LONG_PRESS
+int64_t emu_board_touch(int hold_ms);
+// Backlight brightness in percent, as last set
+int emu_board_brightness(void);
+// Time the backlight was first turned on, -1 if it wasn't
+int64_t emu_board_backlight_on_us(void);
+// Time board_sleep was called, -1 if it wasn't
+int64_t emu_board_sleep_us(void);
@@ -0,0 +1,770 @@
+/**
+ *  Host stand-ins for the ESP-IDF functions used by the code under test.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <assert.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "esp_partition.h"
+#include "sys/lock.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_event.h"
+#include "esp_pm.h"
+#include "idf_emu.h"
+
+// Tasks are threads, of which only the current task runs: it hands over
+// to another task when it blocks, or when it makes a task of higher
+// priority ready. When no task is ready, the clock skips to the next
+// deadline of a timer or a task waiting with a timeout. esp_timer callbacks
+// run in the thread of the task which found them due, as if from the
+// esp_timer task, and mustn't block.
+
+#define EMU_TIMERS_MAX      8
+#define EMU_TASKS_MAX       8
+#define EMU_NO_DEADLINE     INT64_MAX
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool armed;
+    int64_t deadline;
+};
+
+struct host_semaphore {
+    bool given;
+};
+
+struct host_queue {
+    size_t item_size;
+    int length;
+    int head;
+    int count;
+    uint8_t *items;
+};
+
+struct emu_task {
+    const char *name;
+    UBaseType_t priority;
+    TaskFunction_t func;
+    void *arg;
+    pthread_t thread;
+    pthread_cond_t cond;
+    // while blocked: waits until ready(obj) or the deadline
+    bool (*ready)(void *obj);
+    void *obj;
+    int64_t deadline;
+};
+
+static struct esp_timer s_timers[EMU_TIMERS_MAX];
+static int s_timer_count;
+// time skipped while waiting for timers; all the time with the virtual clock
+static int64_t s_skipped_us;
+static bool s_virtual_clock;
+
+// held by the thread of the current task, once there is more than one
+static pthread_mutex_t s_sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_sched_started;
+static struct emu_task s_tasks[EMU_TASKS_MAX] = {
+    { .name = "main", .priority = 1, .cond = PTHREAD_COND_INITIALIZER, .deadline = EMU_NO_DEADLINE },
+};
+static int s_task_count = 1;
+static struct emu_task s_timer_task = { .name = "esp_timer", .priority = 22 };
+static struct emu_task *s_current_task = &s_tasks[0];
+
+static esp_sleep_wakeup_cause_t s_wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+int64_t esp_timer_get_time(void)
+{
+    if (s_virtual_clock) {
+        return s_skipped_us;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 + s_skipped_us;
+}
+
+void emu_advance_time(int64_t us)
+{
+    s_skipped_us += us;
+}
+
+void emu_set_virtual_clock(bool enable)
+{
+    s_virtual_clock = enable;
+    s_skipped_us = 0;
+}
+
+bool emu_clock_is_virtual(void)
+{
+    return s_virtual_clock;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (s_timer_count == EMU_TIMERS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_timer_handle_t timer = &s_timers[s_timer_count++];
+    *timer = (struct esp_timer) {
+        .callback = create_args->callback,
+        .arg = create_args->arg,
+    };
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->deadline = esp_timer_get_time() + timeout_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    return ESP_OK;
+}
+
+/* Timer which expires first, at or before 'until_us' */
+static esp_timer_handle_t next_timer(int64_t until_us)
+{
+    esp_timer_handle_t next = NULL;
+    for (int i = 0; i < s_timer_count; ++i) {
+        if (s_timers[i].armed && s_timers[i].deadline <= until_us &&
+                (next == NULL || s_timers[i].deadline < next->deadline)) {
+            next = &s_timers[i];
+        }
+    }
+    return next;
+}
+
+static void skip_to(int64_t time_us)
+{
+    int64_t wait_us = time_us - esp_timer_get_time();
+    if (wait_us > 0) {
+        s_skipped_us += wait_us;
+    }
+}
+
+static void run_timer(esp_timer_handle_t timer)
+{
+    timer->armed = false;
+    struct emu_task *prev_task = s_current_task;
+    s_current_task = &s_timer_task;
+    timer->callback(timer->arg);
+    s_current_task = prev_task;
+}
+
+static void run_due_timers(void)
+{
+    esp_timer_handle_t timer;
+    while ((timer = next_timer(esp_timer_get_time())) != NULL) {
+        run_timer(timer);
+    }
+}
+
+void emu_run_timers(void)
+{
+    esp_timer_handle_t timer;
+    while ((timer = next_timer(EMU_NO_DEADLINE)) != NULL) {
+        skip_to(timer->deadline);
+        run_timer(timer);
+    }
+}
+
+static bool task_is_ready(const struct emu_task *task)
+{
+    return task->ready == NULL || task->ready(task->obj) ||
+           task->deadline <= esp_timer_get_time();
+}
+
+/* Ready task of the highest priority, the current one if there is a tie */
+static struct emu_task *pick_task(void)
+{
+    struct emu_task *best = task_is_ready(s_current_task) ? s_current_task : NULL;
+    for (int i = 0; i < s_task_count; ++i) {
+        struct emu_task *task = &s_tasks[i];
+        if (task_is_ready(task) && (best == NULL || task->priority > best->priority)) {
+            best = task;
+        }
+    }
+    return best;
+}
+
+/* Earliest time at which a timer or a task waiting with a timeout is due */
+static int64_t next_deadline(void)
+{
+    int64_t next = EMU_NO_DEADLINE;
+    for (int i = 0; i < s_timer_count; ++i) {
+        if (s_timers[i].armed && s_timers[i].deadline < next) {
+            next = s_timers[i].deadline;
+        }
+    }
+    for (int i = 0; i < s_task_count; ++i) {
+        if (s_tasks[i].ready != NULL && s_tasks[i].deadline < next) {
+            next = s_tasks[i].deadline;
+        }
+    }
+    return next;
+}
+
+/* Hand over to 'next' and return when the current task is picked again */
+static void switch_to(struct emu_task *next)
+{
+    struct emu_task *self = s_current_task;
+    s_current_task = next;
+    pthread_cond_signal(&next->cond);
+    while (s_current_task != self) {
+        pthread_cond_wait(&self->cond, &s_sched_lock);
+    }
+}
+
+/* Run what is due before the current task goes on: the timers, and the
+ * tasks of higher priority. If the current task is blocked, also the tasks
+ * of lower priority, skipping time when none is ready.
+ */
+static void schedule(void)
+{
+    struct emu_task *self = s_current_task;
+    while (true) {
+        run_due_timers();
+        struct emu_task *next = pick_task();
+        if (next == self) {
+            return;
+        }
+        if (next != NULL) {
+            switch_to(next);
+            return;
+        }
+        int64_t deadline = next_deadline();
+        if (deadline == EMU_NO_DEADLINE) {
+            fprintf(stderr, "emu: deadlock, task %s waits for nothing that can happen\n", self->name);
+            abort();
+        }
+        skip_to(deadline);
+    }
+}
+
+static void task_yield(void)
+{
+    // timer callbacks run before any task
+    if (s_current_task != &s_timer_task) {
+        schedule();
+    }
+}
+
+/* Block until ready(obj) returns true, for at most 'ticks_to_wait' */
+static bool task_wait(bool (*ready)(void *obj), void *obj, TickType_t ticks_to_wait)
+{
+    if (ready(obj)) {
+        return true;
+    }
+    if (ticks_to_wait == 0) {
+        return false;
+    }
+    struct emu_task *self = s_current_task;
+    if (self == &s_timer_task) {
+        fprintf(stderr, "emu: deadlock, an esp_timer callback blocks\n");
+        abort();
+    }
+    self->ready = ready;
+    self->obj = obj;
+    self->deadline = ticks_to_wait == portMAX_DELAY ? EMU_NO_DEADLINE :
+                     esp_timer_get_time() + (int64_t) ticks_to_wait * portTICK_PERIOD_MS * 1000;
+    schedule();
+    self->ready = NULL;
+    self->deadline = EMU_NO_DEADLINE;
+    return ready(obj);
+}
+
+static bool never(void *obj)
+{
+    return false;
+}
+
+void emu_wait_until(int64_t time_us)
+{
+    if (!s_virtual_clock || time_us <= esp_timer_get_time()) {
+        return;
+    }
+    if (s_current_task == &s_timer_task) {
+        // can't block, nothing else runs meanwhile
+        skip_to(time_us);
+        return;
+    }
+    struct emu_task *self = s_current_task;
+    self->ready = never;
+    self->deadline = time_us;
+    schedule();
+    self->ready = NULL;
+    self->deadline = EMU_NO_DEADLINE;
+}
+
+static void *task_thread(void *arg)
+{
+    struct emu_task *task = arg;
+    pthread_mutex_lock(&s_sched_lock);
+    while (s_current_task != task) {
+        pthread_cond_wait(&task->cond, &s_sched_lock);
+    }
+    task->func(task->arg);
+    fprintf(stderr, "emu: task %s returned\n", task->name);
+    abort();
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_func, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *out_handle)
+{
+    assert(s_current_task != &s_timer_task);
+    if (s_task_count == EMU_TASKS_MAX) {
+        return pdFALSE;
+    }
+    if (!s_sched_started) {
+        pthread_mutex_lock(&s_sched_lock);
+        s_sched_started = true;
+    }
+    struct emu_task *task = &s_tasks[s_task_count++];
+    *task = (struct emu_task) {
+        .name = name,
+        .priority = priority,
+        .func = task_func,
+        .arg = arg,
+        .deadline = EMU_NO_DEADLINE,
+    };
+    pthread_cond_init(&task->cond, NULL);
+    int res = pthread_create(&task->thread, NULL, &task_thread, task);
+    assert(res == 0);
+    (void) res;
+    if (out_handle) {
+        *out_handle = task;
+    }
+    task_yield();
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current_task;
+}
+
+void vTaskDelay(TickType_t ticks_to_delay)
+{
+    task_wait(never, NULL, ticks_to_delay);
+}
+
+static bool semaphore_given(void *obj)
+{
+    return ((struct host_semaphore *) obj)->given;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return calloc(1, sizeof(struct host_semaphore));
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    if (!task_wait(semaphore_given, semaphore, ticks_to_wait)) {
+        return pdFALSE;
+    }
+    semaphore->given = false;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    if (semaphore->given) {
+        return pdFALSE;
+    }
+    semaphore->given = true;
+    task_yield();
+    return pdTRUE;
+}
+
+static bool queue_not_empty(void *obj)
+{
+    return ((struct host_queue *) obj)->count > 0;
+}
+
+static bool queue_not_full(void *obj)
+{
+    struct host_queue *queue = obj;
+    return queue->count < queue->length;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(struct host_queue));
+    assert(queue);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->items = calloc(length, item_size);
+    assert(queue->items);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    if (!task_wait(queue_not_full, queue, ticks_to_wait)) {
+        return pdFALSE;
+    }
+    int tail = (queue->head + queue->count++) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    task_yield();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buf, TickType_t ticks_to_wait)
+{
+    if (!task_wait(queue_not_empty, queue, ticks_to_wait)) {
+        return pdFALSE;
+    }
+    memcpy(buf, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    task_yield();
+    return pdTRUE;
+}
+
+// Default event loop: a task which calls the handlers with copies of the
+// posted data, as esp_event does
+
+#define EMU_EVENT_QUEUE_LEN     32
+#define EMU_EVENT_HANDLERS_MAX  16
+#define EMU_EVENT_TASK_PRIORITY 20
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+} emu_event_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} emu_event_handler_t;
+
+static QueueHandle_t s_event_queue;
+static emu_event_handler_t s_event_handlers[EMU_EVENT_HANDLERS_MAX];
+static int s_event_handler_count;
+
+static void event_task(void *arg)
+{
+    while (true) {
+        emu_event_t event;
+        xQueueReceive(s_event_queue, &event, portMAX_DELAY);
+        for (int i = 0; i < s_event_handler_count; ++i) {
+            const emu_event_handler_t *h = &s_event_handlers[i];
+            if ((h->base == ESP_EVENT_ANY_BASE || h->base == event.base) &&
+                    (h->id == ESP_EVENT_ANY_ID || h->id == event.id)) {
+                h->handler(h->arg, event.base, event.id, event.data);
+            }
+        }
+        free(event.data);
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_event_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_event_queue = xQueueCreate(EMU_EVENT_QUEUE_LEN, sizeof(emu_event_t));
+    if (xTaskCreate(&event_task, "sys_evt", 2048, NULL, EMU_EVENT_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (s_event_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_event_handler_count == EMU_EVENT_HANDLERS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_event_handlers[s_event_handler_count++] = (emu_event_handler_t) {
+        .base = event_base,
+        .id = event_id,
+        .handler = event_handler,
+        .arg = event_handler_arg,
+    };
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                         void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    if (s_event_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    emu_event_t event = { .base = event_base, .id = event_id };
+    if (event_data != NULL && event_data_size > 0) {
+        event.data = malloc(event_data_size);
+        assert(event.data);
+        memcpy(event.data, event_data, event_data_size);
+    }
+    if (xQueueSend(s_event_queue, &event, ticks_to_wait) != pdTRUE) {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_isr_post(esp_event_base_t event_base, int32_t event_id,
+                             void *event_data, size_t event_data_size, BaseType_t *task_unblocked)
+{
+    // the emulated interrupts are raised by the test, from a task
+    esp_err_t err = esp_event_post(event_base, event_id, event_data, event_data_size, 0);
+    if (task_unblocked) {
+        *task_unblocked = pdFALSE;
+    }
+    return err;
+}
+
+// Power management locks, counted by type
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    int count;
+};
+
+#define EMU_PM_LOCKS_MAX    8
+#define EMU_PM_LOCK_TYPES   (ESP_PM_NO_LIGHT_SLEEP + 1)
+
+static struct esp_pm_lock s_pm_locks[EMU_PM_LOCKS_MAX];
+static int s_pm_lock_count;
+static int s_pm_acquired[EMU_PM_LOCK_TYPES];
+
+esp_err_t esp_pm_configure(const void *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name,
+                             esp_pm_lock_handle_t *out_handle)
+{
+    if (s_pm_lock_count == EMU_PM_LOCKS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_pm_lock_handle_t lock = &s_pm_locks[s_pm_lock_count++];
+    lock->type = lock_type;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    handle->count++;
+    s_pm_acquired[handle->type]++;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    if (handle->count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->count--;
+    s_pm_acquired[handle->type]--;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream)
+{
+    for (int i = 0; i < s_pm_lock_count; ++i) {
+        fprintf(stream, "lock %d: type %d, count %d\n", i, s_pm_locks[i].type, s_pm_locks[i].count);
+    }
+    return ESP_OK;
+}
+
+int emu_pm_lock_count(esp_pm_lock_type_t type)
+{
+    return s_pm_acquired[type];
+}
+
+// System time as ESP-IDF keeps it: counted by esp_timer from the time last
+// set with settimeofday, the epoch if it wasn't
+
+static int64_t s_system_time_offset_us;
+
+int settimeofday(const struct timeval *tv, const struct timezone *tz)
+{
+    if (tv != NULL) {
+        s_system_time_offset_us = tv->tv_sec * 1000000LL + tv->tv_usec - esp_timer_get_time();
+    }
+    return 0;
+}
+
+time_t time(time_t *out)
+{
+    time_t now = (s_system_time_offset_us + esp_timer_get_time()) / 1000000;
+    if (out != NULL) {
+        *out = now;
+    }
+    return now;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    return s_wakeup_cause;
+}
+
+void emu_set_wakeup_cause(esp_sleep_wakeup_cause_t cause)
+{
+    s_wakeup_cause = cause;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    static char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", code);
+    return buf;
+}
+
+// In-memory partition, erased (0xff) unless loaded with emu_partition_load
+
+static esp_partition_t s_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = 0x40,
+    .address = 0x110000,
+    .size = 0x100000,
+    .label = "assets",
+};
+static uint8_t *s_partition_data;
+static bool s_partition_present = true;
+// copies of the mapped data, the handle is the index + 1
+#define EMU_MMAP_MAX 8
+static void *s_mmaps[EMU_MMAP_MAX];
+static int s_mmap_count;
+
+static void partition_alloc(void)
+{
+    if (s_partition_data == NULL) {
+        s_partition_data = malloc(s_partition.size);
+        assert(s_partition_data);
+        memset(s_partition_data, 0xff, s_partition.size);
+    }
+}
+
+void emu_partition_load(const void *data, size_t size)
+{
+    partition_alloc();
+    assert(size <= s_partition.size);
+    memset(s_partition_data, 0xff, s_partition.size);
+    memcpy(s_partition_data, data, size);
+}
+
+void emu_partition_set_present(bool present)
+{
+    s_partition_present = present;
+}
+
+int emu_partition_mmap_count(void)
+{
+    return s_mmap_count;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+        esp_partition_subtype_t subtype, const char *label)
+{
+    if (!s_partition_present || type != s_partition.type ||
+            subtype != s_partition.subtype || strcmp(label, s_partition.label) != 0) {
+        return NULL;
+    }
+    return &s_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset,
+                             void *dst, size_t size)
+{
+    partition_alloc();
+    if (src_offset > partition->size || size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, s_partition_data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void **out_ptr,
+                             spi_flash_mmap_handle_t *out_handle)
+{
+    partition_alloc();
+    if (offset > partition->size || size > partition->size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // a copy of exactly the mapped size, so that the sanitizers catch
+    // reads past the end of the mapping
+    int slot = 0;
+    while (slot < EMU_MMAP_MAX && s_mmaps[slot] != NULL) {
+        ++slot;
+    }
+    assert(slot < EMU_MMAP_MAX);
+    void *copy = malloc(size ? size : 1);
+    assert(copy);
+    memcpy(copy, s_partition_data + offset, size);
+    s_mmaps[slot] = copy;
+    *out_ptr = copy;
+    *out_handle = slot + 1;
+    ++s_mmap_count;
+    return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+    assert(handle >= 1 && handle <= EMU_MMAP_MAX && s_mmaps[handle - 1] != NULL);
+    free(s_mmaps[handle - 1]);
+    s_mmaps[handle - 1] = NULL;
+    --s_mmap_count;
+}
+
+// newlib locks, held by a task: they deadlock if taken again by the same task
+
+static int lock_owner_id(void)
+{
+    return s_current_task == &s_timer_task ? EMU_TASKS_MAX + 1 : (int) (s_current_task - s_tasks) + 1;
+}
+
+static bool lock_free(void *obj)
+{
+    return *(_lock_t *) obj == 0;
+}
+
+void _lock_acquire(_lock_t *lock)
+{
+    assert(*lock != lock_owner_id() && "lock taken recursively");
+    task_wait(lock_free, lock, portMAX_DELAY);
+    *lock = lock_owner_id();
+}
+
+void _lock_release(_lock_t *lock)
+{
+    assert(*lock == lock_owner_id() && "lock released by a task which doesn't hold it");
+    *lock = 0;
+    task_yield();
+}
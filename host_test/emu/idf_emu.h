@@ -0,0 +1,37 @@
+/**
+ *  Control of the host stand-ins for ESP-IDF.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_sleep.h"
+#include "esp_pm.h"
+
+// Move esp_timer_get_time forward, without waiting
+void emu_advance_time(int64_t us);
+// Run all armed esp_timer callbacks, skipping the time until each of them
+void emu_run_timers(void);
+// With the virtual clock, esp_timer_get_time starts at 0 and time only passes
+// while tasks wait for timers, timeouts and the emulated buses: code takes no
+// time, and the times measured are the same on every run. Set it before the
+// code under test runs.
+void emu_set_virtual_clock(bool enable);
+bool emu_clock_is_virtual(void);
+// Wait for the emulated hardware until the given time, letting other tasks
+// run meanwhile; does nothing unless the clock is virtual
+void emu_wait_until(int64_t time_us);
+// Number of power management locks of the type held
+int emu_pm_lock_count(esp_pm_lock_type_t type);
+// Value returned by esp_sleep_get_wakeup_cause
+void emu_set_wakeup_cause(esp_sleep_wakeup_cause_t cause);
+// Contents of the "assets" data partition, the rest of it is erased
+void emu_partition_load(const void *data, size_t size);
+// Whether esp_partition_find_first finds the "assets" partition
+void emu_partition_set_present(bool present);
+// Number of mappings not released with spi_flash_munmap
+int emu_partition_mmap_count(void);
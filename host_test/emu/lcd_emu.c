@@ -0,0 +1,464 @@
+/**
+ *  Emulated ST7735 LCD on the SPI bus, for the host tests.
+ *
+ *  Implements the SPI master driver functions used by the st7735 component.
+ *  Bytes are interpreted the way the LCD controller does it, using the D/C
+ *  line set by the pre-transfer callback: memory window, orientation and
+ *  color format commands are applied to an emulated GRAM. Commands sent
+ *  before the delay required by the datasheet has elapsed are reported.
+ *  With the virtual clock (see idf_emu.h), transfers take the time to send
+ *  their bytes at the SPI clock, one after the other.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_timer.h"
+#include "idf_emu.h"
+#include "lcd_emu.h"
+
+#define LCD_DC_PIN      23
+
+#define GRAM_COLS       132
+#define GRAM_ROWS       162
+#define PANEL_COL0      26
+#define PANEL_ROW0      2
+
+#define CMD_SWRESET     0x01
+#define CMD_SLPIN       0x10
+#define CMD_SLPOUT      0x11
+#define CMD_DISPOFF     0x28
+#define CMD_DISPON      0x29
+#define CMD_CASET       0x2a
+#define CMD_RASET       0x2b
+#define CMD_RAMWR       0x2c
+#define CMD_MADCTL      0x36
+#define CMD_IDMOFF      0x38
+#define CMD_IDMON       0x39
+#define CMD_COLMOD      0x3a
+
+#define MADCTL_MY       0x80
+#define MADCTL_MX       0x40
+#define MADCTL_MV       0x20
+
+#define COLMOD_12BIT    3
+
+#define CMD_ANY         0xff
+
+// more than the driver may queue, to detect overflows
+#define QUEUE_LEN       32
+
+/** @struct Minimal time between the starts of two commands, ST7735S datasheet */
+typedef struct {
+    uint8_t after;
+    uint8_t before;     // or CMD_ANY
+    uint32_t delay_us;
+} cmd_timing_t;
+
+static const cmd_timing_t s_cmd_timings[] = {
+    { CMD_SWRESET, CMD_ANY, 5000 },
+    { CMD_SWRESET, CMD_SLPOUT, 120000 },
+    { CMD_SLPOUT, CMD_ANY, 5000 },
+    { CMD_SLPOUT, CMD_SLPIN, 120000 },
+    { CMD_SLPIN, CMD_ANY, 5000 },
+    { CMD_SLPIN, CMD_SLPOUT, 120000 },
+};
+#define CMD_TIMINGS_COUNT (sizeof(s_cmd_timings) / sizeof(s_cmd_timings[0]))
+
+static spi_device_interface_config_t s_dev_cfg;
+static bool s_dev_added;
+static int s_dc;
+
+// transactions queued and not yet reclaimed; they are executed in order
+// when reclaimed, so that buffers modified too early show up on the screen
+static struct {
+    spi_transaction_t *trans;
+    int64_t start_us;   // earliest time the transfer can start
+    int64_t end_us;     // with the virtual clock, when it is finished
+} s_queue[QUEUE_LEN];
+static int s_queue_head;
+static int s_queue_len;
+
+static uint16_t s_gram[GRAM_ROWS][GRAM_COLS];
+static emu_lcd_state_t s_state;
+static emu_lcd_stats_t s_stats;
+
+// command being received and its arguments
+static uint8_t s_cmd;
+static uint8_t s_args[4];
+static int s_arg_count;
+// memory window and write position, in controller addresses
+static int s_xs, s_xe, s_ys, s_ye;
+static int s_x, s_y;
+// bytes (12-bit color: nibbles) of a pixel received so far
+static uint8_t s_pixel_bytes[3];
+static int s_pixel_byte_count;
+// time each command was last sent, -1 if not since the reset
+static int64_t s_cmd_sent_us[256];
+// with the virtual clock, end of the last transfer sent
+static int64_t s_bus_free_us;
+
+void emu_lcd_reset(void)
+{
+    memset(s_gram, 0, sizeof(s_gram));
+    s_state = (emu_lcd_state_t) {
+        .sleeping = true,
+        .colmod = 6,
+    };
+    s_cmd = 0;
+    s_arg_count = 0;
+    s_xs = s_ys = 0;
+    s_xe = GRAM_COLS - 1;
+    s_ye = GRAM_ROWS - 1;
+    for (int i = 0; i < 256; ++i) {
+        s_cmd_sent_us[i] = -1;
+    }
+}
+
+void emu_lcd_get_stats(emu_lcd_stats_t *out)
+{
+    *out = s_stats;
+    if (s_dev_cfg.clock_speed_hz > 0) {
+        out->bus_time_us = (uint64_t) s_stats.bytes * 8 * 1000000 / s_dev_cfg.clock_speed_hz;
+    }
+}
+
+void emu_lcd_reset_stats(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+const emu_lcd_state_t *emu_lcd_state(void)
+{
+    return &s_state;
+}
+
+static void error(const char *msg)
+{
+    fprintf(stderr, "lcd_emu: %s\n", msg);
+    s_stats.errors++;
+}
+
+/* GRAM cell written at controller address x, y with the current MADCTL */
+static void addr_to_gram(int x, int y, int *col, int *row)
+{
+    bool mv = s_state.madctl & MADCTL_MV;
+    *col = mv ? y : x;
+    *row = mv ? x : y;
+    if (s_state.madctl & MADCTL_MX) {
+        *col = GRAM_COLS - 1 - *col;
+    }
+    if (s_state.madctl & MADCTL_MY) {
+        *row = GRAM_ROWS - 1 - *row;
+    }
+}
+
+static void put_pixel(uint16_t color)
+{
+    int col, row;
+    addr_to_gram(s_x, s_y, &col, &row);
+    s_stats.pixels++;
+    if (col < 0 || col >= GRAM_COLS || row < 0 || row >= GRAM_ROWS) {
+        s_stats.hidden_pixels++;
+    } else {
+        s_gram[row][col] = color;
+        if (col < PANEL_COL0 || col >= PANEL_COL0 + EMU_LCD_PANEL_WIDTH ||
+                row < PANEL_ROW0 || row >= PANEL_ROW0 + EMU_LCD_PANEL_HEIGHT) {
+            s_stats.hidden_pixels++;
+        }
+    }
+    if (++s_x > s_xe) {
+        s_x = s_xs;
+        if (++s_y > s_ye) {
+            s_y = s_ys;
+        }
+    }
+}
+
+static void pixel_byte(uint8_t b)
+{
+    if (s_state.colmod == COLMOD_12BIT) {
+        // two pixels in three bytes; each pixel is written as soon as
+        // its 12 bits are received, so an odd pixel takes two bytes
+        for (int shift = 4; shift >= 0; shift -= 4) {
+            s_pixel_bytes[s_pixel_byte_count++] = (b >> shift) & 0xf;
+            if (s_pixel_byte_count == 3) {
+                uint32_t hi = s_pixel_bytes[0], mid = s_pixel_bytes[1], lo = s_pixel_bytes[2];
+                // expanded to 16 bits
+                put_pixel((hi << 1 | hi >> 3) << 11 | (mid << 2 | mid >> 2) << 5 | (lo << 1 | lo >> 3));
+                s_pixel_byte_count = 0;
+            }
+        }
+        return;
+    }
+    s_pixel_bytes[s_pixel_byte_count++] = b;
+    if (s_pixel_byte_count == 2) {
+        // most significant byte first
+        put_pixel(s_pixel_bytes[0] << 8 | s_pixel_bytes[1]);
+        s_pixel_byte_count = 0;
+    }
+}
+
+/* Report the command if it is sent too soon after one of the previous commands */
+static void check_timing(uint8_t cmd, int64_t now_us)
+{
+    for (int i = 0; i < CMD_TIMINGS_COUNT; ++i) {
+        const cmd_timing_t *timing = &s_cmd_timings[i];
+        int64_t sent_us = s_cmd_sent_us[timing->after];
+        if (sent_us < 0 || (timing->before != cmd && timing->before != CMD_ANY)) {
+            continue;
+        }
+        if (now_us - sent_us < timing->delay_us) {
+            fprintf(stderr, "lcd_emu: command 0x%02x sent %d us after 0x%02x, %d us required\n",
+                    cmd, (int) (now_us - sent_us), timing->after, (int) timing->delay_us);
+            s_stats.timing_violations++;
+        }
+    }
+    s_cmd_sent_us[cmd] = now_us;
+}
+
+static void command(uint8_t cmd, int64_t now_us)
+{
+    check_timing(cmd, now_us);
+    s_cmd = cmd;
+    s_arg_count = 0;
+    s_pixel_byte_count = 0;
+    s_stats.commands++;
+    switch (cmd) {
+    case CMD_SWRESET:
+        s_state.madctl = 0;
+        s_state.display_on = false;
+        s_state.idle = false;
+        s_state.sleeping = true;
+        break;
+    case CMD_SLPIN:
+        s_state.sleeping = true;
+        break;
+    case CMD_SLPOUT:
+        s_state.sleeping = false;
+        break;
+    case CMD_DISPOFF:
+        s_state.display_on = false;
+        break;
+    case CMD_DISPON:
+        s_state.display_on = true;
+        break;
+    case CMD_IDMOFF:
+        s_state.idle = false;
+        break;
+    case CMD_IDMON:
+        s_state.idle = true;
+        break;
+    case CMD_RAMWR:
+        s_x = s_xs;
+        s_y = s_ys;
+        break;
+    }
+}
+
+static void data(uint8_t b)
+{
+    if (s_cmd == CMD_RAMWR) {
+        pixel_byte(b);
+        return;
+    }
+    if (s_arg_count < (int) sizeof(s_args)) {
+        s_args[s_arg_count] = b;
+    }
+    s_arg_count++;
+    switch (s_cmd) {
+    case CMD_CASET:
+        if (s_arg_count == 4) {
+            s_xs = s_args[0] << 8 | s_args[1];
+            s_xe = s_args[2] << 8 | s_args[3];
+        }
+        break;
+    case CMD_RASET:
+        if (s_arg_count == 4) {
+            s_ys = s_args[0] << 8 | s_args[1];
+            s_ye = s_args[2] << 8 | s_args[3];
+        }
+        break;
+    case CMD_MADCTL:
+        s_state.madctl = b;
+        break;
+    case CMD_COLMOD:
+        s_state.colmod = b & 0x7;
+        break;
+    }
+}
+
+/* Start time of a transfer of 't' requested now. With the virtual clock, it
+ * starts after the transfers before it, and 'end_us' is when it's finished.
+ */
+static int64_t bus_start(const spi_transaction_t *t, int64_t *end_us)
+{
+    int64_t now = esp_timer_get_time();
+    *end_us = now;
+    if (!emu_clock_is_virtual() || s_dev_cfg.clock_speed_hz <= 0) {
+        return now;
+    }
+    int64_t start_us = s_bus_free_us > now ? s_bus_free_us : now;
+    s_bus_free_us = start_us + (int64_t) t->length * 1000000 / s_dev_cfg.clock_speed_hz;
+    *end_us = s_bus_free_us;
+    return start_us;
+}
+
+static void execute(spi_transaction_t *t, int64_t start_us)
+{
+    if (s_dev_cfg.pre_cb) {
+        s_dev_cfg.pre_cb(t);
+    }
+    const uint8_t *bytes = (t->flags & SPI_TRANS_USE_TXDATA) ? t->tx_data : t->tx_buffer;
+    size_t len = t->length / 8;
+    if ((t->flags & SPI_TRANS_USE_TXDATA) && len > 4) {
+        error("SPI_TRANS_USE_TXDATA with more than 4 bytes");
+        len = 4;
+    }
+    s_stats.transactions++;
+    s_stats.bytes += len;
+    for (size_t i = 0; i < len; ++i) {
+        if (s_dc) {
+            data(bytes[i]);
+        } else {
+            // each byte sent with D/C low is a command
+            command(bytes[i], start_us);
+        }
+    }
+    if (s_dev_cfg.post_cb) {
+        s_dev_cfg.post_cb(t);
+    }
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num == LCD_DC_PIN) {
+        s_dc = level;
+    }
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config, int dma_chan)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *dev_config,
+                             spi_device_handle_t *handle)
+{
+    // the driver initializes the bus on every wake up, as after a reset
+    s_dev_cfg = *dev_config;
+    s_dev_added = true;
+    *handle = (spi_device_handle_t) &s_dev_cfg;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc)
+{
+    if (!s_dev_added) {
+        error("polling transmit without a device");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_queue_len > 0) {
+        error("polling transmit while queued transactions are pending");
+        return ESP_ERR_INVALID_STATE;
+    }
+    int64_t end_us;
+    execute(trans_desc, bus_start(trans_desc, &end_us));
+    emu_wait_until(end_us);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc,
+                                 TickType_t ticks_to_wait)
+{
+    if (!s_dev_added) {
+        error("queue_trans without a device");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_queue_len >= s_dev_cfg.queue_size) {
+        // would block forever, nothing else reclaims the transactions
+        error("queue_trans with a full queue");
+        abort();
+    }
+    int idx = (s_queue_head + s_queue_len++) % QUEUE_LEN;
+    s_queue[idx].trans = trans_desc;
+    s_queue[idx].start_us = bus_start(trans_desc, &s_queue[idx].end_us);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans_desc,
+                                      TickType_t ticks_to_wait)
+{
+    if (s_queue_len == 0) {
+        if (ticks_to_wait == 0) {
+            return ESP_ERR_TIMEOUT;
+        }
+        error("get_trans_result with nothing queued");
+        abort();
+    }
+    spi_transaction_t *t = s_queue[s_queue_head].trans;
+    int64_t start_us = s_queue[s_queue_head].start_us;
+    int64_t end_us = s_queue[s_queue_head].end_us;
+    s_queue_head = (s_queue_head + 1) % QUEUE_LEN;
+    s_queue_len--;
+    emu_wait_until(end_us);
+    execute(t, start_us);
+    *trans_desc = t;
+    return ESP_OK;
+}
+
+int emu_lcd_width(void)
+{
+    return (s_state.madctl & MADCTL_MV) ? EMU_LCD_PANEL_HEIGHT : EMU_LCD_PANEL_WIDTH;
+}
+
+int emu_lcd_height(void)
+{
+    return (s_state.madctl & MADCTL_MV) ? EMU_LCD_PANEL_WIDTH : EMU_LCD_PANEL_HEIGHT;
+}
+
+uint16_t emu_lcd_pixel(int x, int y)
+{
+    assert(x >= 0 && x < emu_lcd_width() && y >= 0 && y < emu_lcd_height());
+    // lowest controller addresses of the visible area; mirroring the rows
+    // moves the two unused GRAM rows to the other end
+    int row_addr0 = (s_state.madctl & MADCTL_MY) ? 0 : PANEL_ROW0;
+    bool mv = s_state.madctl & MADCTL_MV;
+    int col, row;
+    addr_to_gram(x + (mv ? row_addr0 : PANEL_COL0), y + (mv ? PANEL_COL0 : row_addr0), &col, &row);
+    return s_gram[row][col];
+}
+
+uint16_t emu_lcd_panel_pixel(int x, int y)
+{
+    assert(x >= 0 && x < EMU_LCD_PANEL_WIDTH && y >= 0 && y < EMU_LCD_PANEL_HEIGHT);
+    return s_gram[PANEL_ROW0 + y][PANEL_COL0 + x];
+}
+
+bool emu_lcd_dump_ppm(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", emu_lcd_width(), emu_lcd_height());
+    for (int y = 0; y < emu_lcd_height(); ++y) {
+        for (int x = 0; x < emu_lcd_width(); ++x) {
+            // the panel has a BGR color filter, see MADCTL
+            uint16_t v = emu_lcd_pixel(x, y);
+            uint8_t rgb[3] = {
+                (v & 0x1f) << 3, ((v >> 5) & 0x3f) << 2, (v >> 11) << 3
+            };
+            fwrite(rgb, 1, sizeof(rgb), f);
+        }
+    }
+    fclose(f);
+    return true;
+}
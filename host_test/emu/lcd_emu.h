@@ -0,0 +1,51 @@
+/**
+ *  Emulated ST7735 LCD on the SPI bus, for the host tests.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Panel as mounted: GRAM columns [26, 106), rows [2, 162)
+#define EMU_LCD_PANEL_WIDTH     80
+#define EMU_LCD_PANEL_HEIGHT    160
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t commands;
+    uint32_t bytes;             // command and data bytes
+    uint32_t bus_time_us;       // time to send the bytes at the SPI clock
+    uint32_t pixels;            // pixels written to GRAM
+    uint32_t hidden_pixels;     // of them, pixels not visible on the panel
+    uint32_t errors;            // SPI driver misuse, see the log
+    uint32_t timing_violations; // commands sent too early, see the log
+} emu_lcd_stats_t;
+
+typedef struct {
+    bool sleeping;
+    bool display_on;
+    bool idle;
+    uint8_t madctl;
+    uint8_t colmod;
+} emu_lcd_state_t;
+
+// Power-on state of the LCD, GRAM is black
+void emu_lcd_reset(void);
+void emu_lcd_get_stats(emu_lcd_stats_t *out);
+void emu_lcd_reset_stats(void);
+const emu_lcd_state_t *emu_lcd_state(void);
+
+// Size of the visible area, as addressed with the current MADCTL
+int emu_lcd_width(void);
+int emu_lcd_height(void);
+// Pixels are 16-bit values as sent to the LCD: the panel has a BGR filter,
+// so blue is in the most significant bits.
+// Visible pixel, as addressed with the current MADCTL
+uint16_t emu_lcd_pixel(int x, int y);
+// Pixel of the panel as mounted, independent of MADCTL
+uint16_t emu_lcd_panel_pixel(int x, int y);
+// Write what the panel shows to a binary PPM file, as addressed with the current MADCTL
+bool emu_lcd_dump_ppm(const char *path);
@@ -0,0 +1,308 @@
+/**
+ *  Emulated PCF8563 RTC on the I2C bus, for the host tests.
+ *
+ *  Implements the I2C master driver functions used by the i2c_bus component.
+ *  Command links are kept as lists of operations and run against the
+ *  registers of the RTC when i2c_master_cmd_begin is called. As with the
+ *  driver before IDF 4.4, a link is consumed by running it: running it again
+ *  is reported as an error. Register writes follow the datasheet, e.g. the
+ *  CTRL2 flags are only cleared by writing 0. With the virtual clock (see
+ *  idf_emu.h), a transfer takes the time to clock its bits at the bus speed.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "driver/i2c.h"
+#include "esp_timer.h"
+#include "idf_emu.h"
+#include "rtc_emu.h"
+
+#define REG_CTRL2           0x01
+#define REG_TIMER_CTRL      0x0e
+#define CTRL2_TIE           0x01
+#define CTRL2_AIE           0x02
+#define CTRL2_TF            0x04
+#define CTRL2_AF            0x08
+#define CTRL2_MASK          0x1f
+#define TIMER_CTRL_TE       0x80
+
+#define LINK_MAX_OPS        8
+
+typedef enum {
+    OP_START,
+    OP_STOP,
+    OP_WRITE,
+    OP_READ,
+} op_type_t;
+
+typedef struct {
+    op_type_t type;
+    uint8_t byte;           // for a single byte write
+    uint8_t *data;          // referenced, as the driver does
+    size_t len;
+} op_t;
+
+typedef struct {
+    op_t ops[LINK_MAX_OPS];
+    int count;
+    bool consumed;
+} link_t;
+
+static bool s_installed[I2C_NUM_MAX];
+static bool s_configured[I2C_NUM_MAX];
+static uint32_t s_clk_speed[I2C_NUM_MAX];
+static uint8_t s_regs[EMU_RTC_REG_COUNT];
+static int s_reg_ptr;
+static emu_rtc_stats_t s_stats;
+
+void emu_rtc_reset(void)
+{
+    memset(s_regs, 0, sizeof(s_regs));
+    s_regs[0x00] = 0x08;
+    // VL set: the clock integrity isn't guaranteed
+    s_regs[0x02] = 0x80;
+    // alarms disabled
+    s_regs[0x09] = s_regs[0x0a] = s_regs[0x0b] = s_regs[0x0c] = 0x80;
+    s_regs[0x0d] = 0x80;
+    s_regs[REG_TIMER_CTRL] = 0x03;
+    s_reg_ptr = 0;
+    memset(s_installed, 0, sizeof(s_installed));
+    memset(s_configured, 0, sizeof(s_configured));
+}
+
+void emu_rtc_get_stats(emu_rtc_stats_t *out)
+{
+    *out = s_stats;
+}
+
+void emu_rtc_reset_stats(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+uint8_t emu_rtc_reg(int reg)
+{
+    assert(reg >= 0 && reg < EMU_RTC_REG_COUNT);
+    return s_regs[reg];
+}
+
+void emu_rtc_set_reg(int reg, uint8_t val)
+{
+    assert(reg >= 0 && reg < EMU_RTC_REG_COUNT);
+    s_regs[reg] = val;
+}
+
+void emu_rtc_alarm(void)
+{
+    s_regs[REG_CTRL2] |= CTRL2_AF;
+}
+
+void emu_rtc_timer(void)
+{
+    if (s_regs[REG_TIMER_CTRL] & TIMER_CTRL_TE) {
+        s_regs[REG_CTRL2] |= CTRL2_TF;
+    }
+}
+
+bool emu_rtc_int_active(void)
+{
+    uint8_t ctrl2 = s_regs[REG_CTRL2];
+    return ((ctrl2 & CTRL2_AF) && (ctrl2 & CTRL2_AIE)) ||
+           ((ctrl2 & CTRL2_TF) && (ctrl2 & CTRL2_TIE));
+}
+
+static void error(const char *msg)
+{
+    fprintf(stderr, "rtc_emu: %s\n", msg);
+    s_stats.errors++;
+}
+
+static void reg_write(uint8_t val)
+{
+    if (s_reg_ptr == REG_CTRL2) {
+        // flags are cleared by writing 0, writing 1 leaves them as they are
+        uint8_t flags = CTRL2_TF | CTRL2_AF;
+        val = (val & ~flags) | (val & s_regs[REG_CTRL2] & flags);
+        val &= CTRL2_MASK;
+    }
+    s_regs[s_reg_ptr] = val;
+    // the register address wraps around after the last one
+    s_reg_ptr = (s_reg_ptr + 1) % EMU_RTC_REG_COUNT;
+    s_stats.bytes++;
+}
+
+static uint8_t reg_read(void)
+{
+    uint8_t val = s_regs[s_reg_ptr];
+    s_reg_ptr = (s_reg_ptr + 1) % EMU_RTC_REG_COUNT;
+    s_stats.bytes++;
+    return val;
+}
+
+/* Clock cycles to run a link: 9 per byte with the acknowledge, 1 per start or stop */
+static uint32_t link_cycles(const link_t *link)
+{
+    uint32_t cycles = 0;
+    for (int i = 0; i < link->count; ++i) {
+        const op_t *op = &link->ops[i];
+        cycles += (op->type == OP_START || op->type == OP_STOP) ? 1 : op->len * 9;
+    }
+    return cycles;
+}
+
+/* Run the operations of a link; returns false if the RTC didn't respond */
+static bool run(const link_t *link)
+{
+    bool addressed = false;     // the next written byte is an address
+    bool selected = false;
+    bool reading = false;
+    bool reg_set = false;       // first byte of a write sets the register
+    for (int i = 0; i < link->count; ++i) {
+        const op_t *op = &link->ops[i];
+        switch (op->type) {
+        case OP_START:
+            addressed = true;
+            reg_set = false;
+            break;
+        case OP_STOP:
+            addressed = false;
+            selected = false;
+            break;
+        case OP_WRITE:
+            for (size_t n = 0; n < op->len; ++n) {
+                uint8_t b = op->data ? op->data[n] : op->byte;
+                if (addressed) {
+                    addressed = false;
+                    selected = (b >> 1) == EMU_RTC_ADDR;
+                    reading = b & I2C_MASTER_READ;
+                    if (!selected) {
+                        s_stats.nacks++;
+                        return false;
+                    }
+                } else if (!selected || reading) {
+                    error("write without a write address");
+                } else if (!reg_set) {
+                    s_reg_ptr = b % EMU_RTC_REG_COUNT;
+                    reg_set = true;
+                } else {
+                    reg_write(b);
+                }
+            }
+            break;
+        case OP_READ:
+            if (!selected || !reading) {
+                error("read without a read address");
+                break;
+            }
+            for (size_t n = 0; n < op->len; ++n) {
+                op->data[n] = reg_read();
+            }
+            break;
+        }
+    }
+    if (selected) {
+        error("command link doesn't end with a stop");
+    }
+    return true;
+}
+
+static esp_err_t add_op(i2c_cmd_handle_t cmd_handle, op_t op)
+{
+    link_t *link = cmd_handle;
+    assert(link != NULL);
+    if (link->count >= LINK_MAX_OPS) {
+        error("too many operations in a command link");
+        return ESP_ERR_NO_MEM;
+    }
+    link->ops[link->count++] = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len,
+                             size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    assert(i2c_num >= 0 && i2c_num < I2C_NUM_MAX);
+    if (s_installed[i2c_num]) {
+        return ESP_FAIL;
+    }
+    s_installed[i2c_num] = true;
+    return ESP_OK;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    assert(i2c_num >= 0 && i2c_num < I2C_NUM_MAX);
+    if (i2c_conf->mode != I2C_MODE_MASTER || i2c_conf->master.clk_speed == 0 ||
+            i2c_conf->master.clk_speed > 400000) {
+        error("unsupported I2C configuration");
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_configured[i2c_num] = true;
+    s_clk_speed[i2c_num] = i2c_conf->master.clk_speed;
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    link_t *link = calloc(1, sizeof(link_t));
+    assert(link);
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return add_op(cmd_handle, (op_t) { .type = OP_START });
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return add_op(cmd_handle, (op_t) { .type = OP_STOP });
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    return add_op(cmd_handle, (op_t) { .type = OP_WRITE, .byte = data, .len = 1 });
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len,
+                           bool ack_en)
+{
+    assert(data != NULL && data_len > 0);
+    return add_op(cmd_handle, (op_t) { .type = OP_WRITE, .data = data, .len = data_len });
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len,
+                          i2c_ack_type_t ack)
+{
+    assert(data != NULL && data_len > 0);
+    return add_op(cmd_handle, (op_t) { .type = OP_READ, .data = data, .len = data_len });
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle,
+                               TickType_t ticks_to_wait)
+{
+    link_t *link = cmd_handle;
+    assert(i2c_num >= 0 && i2c_num < I2C_NUM_MAX);
+    if (!s_installed[i2c_num] || !s_configured[i2c_num]) {
+        error("transfer on a port which isn't set up");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (link->consumed) {
+        error("command link run again after it was consumed");
+        return ESP_ERR_INVALID_STATE;
+    }
+    link->consumed = true;
+    s_stats.transfers++;
+    emu_wait_until(esp_timer_get_time() + (int64_t) link_cycles(link) * 1000000 / s_clk_speed[i2c_num]);
+    return run(link) ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,34 @@
+/**
+ *  Emulated PCF8563 RTC on the I2C bus, for the host tests.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EMU_RTC_ADDR        0x51
+#define EMU_RTC_REG_COUNT   16
+
+typedef struct {
+    uint32_t transfers;         // command links run
+    uint32_t bytes;             // register bytes read or written
+    uint32_t nacks;             // transfers to other addresses
+    uint32_t errors;            // I2C driver misuse, see the log
+} emu_rtc_stats_t;
+
+// Power-on register values; the clock doesn't run, time only changes when written
+void emu_rtc_reset(void);
+void emu_rtc_get_stats(emu_rtc_stats_t *out);
+void emu_rtc_reset_stats(void);
+// Register value, or set it as the chip itself would, bypassing the write rules
+uint8_t emu_rtc_reg(int reg);
+void emu_rtc_set_reg(int reg, uint8_t val);
+// Alarm time reached: sets AF
+void emu_rtc_alarm(void);
+// Countdown timer reached zero: sets TF if the timer is enabled
+void emu_rtc_timer(void);
+// Whether the INT pin is pulled low
+bool emu_rtc_int_active(void);
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_bit_defs.h"
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE,
+    GPIO_PULLUP_ENABLE,
+} gpio_pullup_t;
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
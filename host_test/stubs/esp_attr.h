@@ -0,0 +1,6 @@
+#pragma once
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define DMA_ATTR
+#define RTC_DATA_ATTR
+#define RTC_IRAM_ATTR
@@ -0,0 +1,3 @@
+#pragma once
+#define BIT(nr)     (1UL << (nr))
+#define BIT64(nr)   (1ULL << (nr))
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define portMAX_DELAY       ((TickType_t) 0xffffffff)
+#define portTICK_PERIOD_MS  10
+#define portTICK_RATE_MS    portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)   ((TickType_t) (ms) / portTICK_PERIOD_MS)
+#define pdTRUE      1
+#define pdFALSE     0
+#define pdPASS      pdTRUE
+
+// Only one task runs at a time, there is nothing to lock against
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    0
+#define portENTER_CRITICAL(mux)         ((void) (mux))
+#define portEXIT_CRITICAL(mux)          ((void) (mux))
+#define portYIELD_FROM_ISR()
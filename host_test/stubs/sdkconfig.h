@@ -0,0 +1,19 @@
+/* Configuration of the host test builds. Options which differ between
+ * test targets are set as compile definitions in host_test/CMakeLists.txt.
+ */
+#pragma once
+
+#ifndef CONFIG_ST7735_SPI_CLOCK_MHZ
+#define CONFIG_ST7735_SPI_CLOCK_MHZ 10
+#endif
+#define CONFIG_ST7735_INIT_SKIP_RESET_DEFAULTS 1
+#ifndef CONFIG_ST7735_INIT_DELAY_PERCENT
+#define CONFIG_ST7735_INIT_DELAY_PERCENT 100
+#endif
+#define CONFIG_APP_DISPLAY_ROTATION 0
+
+#if CONFIG_ST7735_FB_8BPP || CONFIG_ST7735_FB_4BPP
+#define CONFIG_ST7735_FB_PALETTE 1
+#elif CONFIG_ST7735_FRAMEBUFFER
+#define CONFIG_ST7735_FB_RGB565 1
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+
+// newlib locks; the emulator checks that they aren't taken recursively
+typedef int _lock_t;
+
+void _lock_acquire(_lock_t *lock);
+void _lock_release(_lock_t *lock);
@@ -0,0 +1,226 @@
+/**
+ *  Tests of the anti-aliased drawing of the st7735 driver, on the emulated LCD.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "display.h"
+#include "st7735.h"
+#include "lcd_emu.h"
+#include "test_util.h"
+
+#define ONE ST7735_AA_ONE
+
+// colors in the byte order of the drawing functions, and as shown by the LCD
+#define BLACK   0x0000
+#define WHITE   0xffff
+
+static uint16_t swap(uint16_t c)
+{
+    return (c >> 8) | (c << 8);
+}
+
+static void clear(uint16_t color)
+{
+    st7735_clear_screen(color);
+    st7735_update_screen();
+}
+
+static void show(void)
+{
+    st7735_update_screen();
+    display_flush();
+}
+
+/* Part of the pixel covered, from the green component of white over black */
+static double coverage(int x, int y)
+{
+    return ((emu_lcd_pixel(x, y) >> 5) & 0x3f) / 63.0;
+}
+
+static double covered_area(void)
+{
+    double area = 0;
+    for (int y = 0; y < emu_lcd_height(); ++y) {
+        for (int x = 0; x < emu_lcd_width(); ++x) {
+            area += coverage(x, y);
+        }
+    }
+    return area;
+}
+
+/* Sine and cosine are within 1 of the rounded exact values, for any angle */
+static void test_sin_cos(void)
+{
+    int worst = 0;
+    for (int angle = -ST7735_AA_TURN; angle <= 2 * ST7735_AA_TURN; ++angle) {
+        double rad = angle * 2 * M_PI / ST7735_AA_TURN;
+        int sin_error = abs(st7735_aa_sin(angle) - (int) lround(sin(rad) * 16384));
+        int cos_error = abs(st7735_aa_cos(angle) - (int) lround(cos(rad) * 16384));
+        worst = sin_error > worst ? sin_error : worst;
+        worst = cos_error > worst ? cos_error : worst;
+    }
+    TEST_CHECK(worst <= 1);
+    TEST_CHECK_EQ(16384, st7735_aa_sin(ST7735_AA_TURN / 4));
+    TEST_CHECK_EQ(-16384, st7735_aa_cos(ST7735_AA_TURN / 2));
+}
+
+/* Angles are clockwise from 12 o'clock, which is towards smaller y */
+static void test_polar(void)
+{
+    int x, y;
+    st7735_aa_polar(40 * ONE, 40 * ONE, 20 * ONE, 0, &x, &y);
+    TEST_CHECK_EQ(40 * ONE, x);
+    TEST_CHECK_EQ(20 * ONE, y);
+    st7735_aa_polar(40 * ONE, 40 * ONE, 20 * ONE, ST7735_AA_TURN / 4, &x, &y);
+    TEST_CHECK_EQ(60 * ONE, x);
+    TEST_CHECK_EQ(40 * ONE, y);
+    for (int angle = 0; angle < ST7735_AA_TURN; angle += 7) {
+        double rad = angle * 2 * M_PI / ST7735_AA_TURN;
+        st7735_aa_polar(0, 0, 35 * ONE, angle, &x, &y);
+        TEST_CHECK(fabs(x - 35 * ONE * sin(rad)) <= 1);
+        TEST_CHECK(fabs(y + 35 * ONE * cos(rad)) <= 1);
+    }
+}
+
+/* Blending matches blending each component separately, rounded down */
+static void test_blend(void)
+{
+    srand(1);
+    for (int round = 0; round < 50; ++round) {
+        uint16_t fg = rand() & 0xffff;
+        uint16_t bg = rand() & 0xffff;
+        uint8_t alpha[33];
+        for (int i = 0; i <= 32; ++i) {
+            alpha[i] = i;
+        }
+        st7735_fill_rect(0, 32, 0, 0, bg);
+        st7735_blend_span(0, 0, alpha, 33, fg);
+        show();
+        uint16_t f = swap(fg);
+        uint16_t b = swap(bg);
+        for (int a = 0; a <= 32; ++a) {
+            uint16_t expected = 0;
+            const int shifts[] = { 11, 5, 0 };
+            const int masks[] = { 0x1f, 0x3f, 0x1f };
+            for (int c = 0; c < 3; ++c) {
+                int fc = (f >> shifts[c]) & masks[c];
+                int bc = (b >> shifts[c]) & masks[c];
+                expected |= (bc + (((fc - bc) * a) >> 5)) << shifts[c];
+            }
+            TEST_CHECK_EQ(expected, emu_lcd_pixel(a, 0));
+        }
+    }
+}
+
+/* Spans are clipped to the screen, pixels not covered at all are kept */
+static void test_blend_clip(void)
+{
+    uint8_t alpha[200];
+    for (int i = 0; i < 200; ++i) {
+        alpha[i] = 32;
+    }
+    clear(BLACK);
+    st7735_blend_span(-20, 5, alpha, 200, WHITE);
+    st7735_blend_span(0, -1, alpha, 10, WHITE);
+    st7735_blend_span(0, st7735_height(), alpha, 10, WHITE);
+    show();
+    TEST_CHECK_EQ(0xffff, emu_lcd_pixel(0, 5));
+    TEST_CHECK_EQ(0xffff, emu_lcd_pixel(st7735_width() - 1, 5));
+    TEST_CHECK_EQ(0, emu_lcd_pixel(0, 4));
+    TEST_CHECK_EQ(0, emu_lcd_pixel(0, 6));
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.hidden_pixels);
+}
+
+/* A line one pixel wide along the pixel centers covers exactly one row */
+static void test_line_horizontal(void)
+{
+    clear(BLACK);
+    st7735_aa_line(10 * ONE, 20 * ONE, 50 * ONE, 20 * ONE, ONE, WHITE);
+    show();
+    for (int x = 11; x < 50; ++x) {
+        TEST_CHECK_EQ(0xffff, emu_lcd_pixel(x, 20));
+        TEST_CHECK_EQ(0, emu_lcd_pixel(x, 19));
+        TEST_CHECK_EQ(0, emu_lcd_pixel(x, 21));
+    }
+}
+
+/* Covered area of lines and circles is close to the exact area,
+ * in every direction
+ */
+static void test_area(void)
+{
+    const double length = 30;
+    const double width = 3;
+    for (int angle = 0; angle < ST7735_AA_TURN; angle += ST7735_AA_TURN / 24 + 1) {
+        int x, y;
+        st7735_aa_polar(80 * ONE, 40 * ONE, (int) length * ONE, angle, &x, &y);
+        clear(BLACK);
+        st7735_aa_line(80 * ONE, 40 * ONE, x, y, (int) width * ONE, WHITE);
+        show();
+        // with round ends
+        double expected = length * width + M_PI * width * width / 4;
+        TEST_CHECK(fabs(covered_area() - expected) < expected * 0.03);
+    }
+
+    for (int r = 3; r <= 35; r += 8) {
+        clear(BLACK);
+        st7735_aa_fill_circle(80 * ONE + ONE / 3, 40 * ONE + ONE / 4, r * ONE, WHITE);
+        show();
+        double expected = M_PI * r * r;
+        TEST_CHECK(fabs(covered_area() - expected) < expected * 0.03);
+    }
+
+    clear(BLACK);
+    st7735_aa_circle(80 * ONE, 40 * ONE, 30 * ONE, 2 * ONE, WHITE);
+    show();
+    double ring = M_PI * (31.0 * 31.0 - 29.0 * 29.0);
+    TEST_CHECK(fabs(covered_area() - ring) < ring * 0.03);
+
+    // a quarter of the ring
+    clear(BLACK);
+    st7735_aa_arc(80 * ONE, 40 * ONE, 30 * ONE, 2 * ONE, 0, ST7735_AA_TURN / 4, WHITE);
+    show();
+    TEST_CHECK(fabs(covered_area() - ring / 4) < ring / 4 * 0.05);
+    // only in the top right quadrant
+    TEST_CHECK(coverage(110, 40) > 0.4);
+    TEST_CHECK(coverage(80, 10) > 0.4);
+    TEST_CHECK_EQ(0, emu_lcd_pixel(50, 40));
+    TEST_CHECK_EQ(0, emu_lcd_pixel(80, 70));
+}
+
+/* Shapes reaching outside of the screen are clipped */
+static void test_offscreen(void)
+{
+    clear(BLACK);
+    st7735_aa_line(-100 * ONE, -50 * ONE, 250 * ONE, 130 * ONE, 4 * ONE, WHITE);
+    st7735_aa_fill_circle(0, 0, 60 * ONE, WHITE);
+    st7735_aa_circle(st7735_width() * ONE, st7735_height() * ONE, 50 * ONE, 3 * ONE, WHITE);
+    show();
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.hidden_pixels);
+    TEST_CHECK_EQ(0, stats.errors);
+    TEST_CHECK_EQ(0xffff, emu_lcd_pixel(0, 0));
+}
+
+int main(void)
+{
+    emu_lcd_reset();
+    display_init();
+    display_wait_ready();
+    TEST_RUN(test_sin_cos);
+    TEST_RUN(test_polar);
+    TEST_RUN(test_blend);
+    TEST_RUN(test_blend_clip);
+    TEST_RUN(test_line_horizontal);
+    TEST_RUN(test_area);
+    TEST_RUN(test_offscreen);
+    return TEST_RESULT();
+}
@@ -0,0 +1,228 @@
+/**
+ *  Test of the application on the emulated board: boot as app_main does it,
+ *  then touches handled by the power states and the display task.
+ *
+ *  Runs with the virtual clock, so the times reported only include the LCD
+ *  command delays and the time the SPI and I2C transfers take, not the time
+ *  the code runs; they are the same on every run.
+ *
+ *      test_app [max boot-to-first-pixel, us] [max touch-to-redraw, us]
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "board.h"
+#include "boot_profile.h"
+#include "display_task.h"
+#include "power_state.h"
+#include "board_emu.h"
+#include "idf_emu.h"
+#include "lcd_emu.h"
+#include "rtc_emu.h"
+#include "test_util.h"
+
+#define TOUCH_HOLD_MS   100
+
+void app_main(void);
+
+static SemaphoreHandle_t s_frame_done;
+static int64_t s_frame_done_us;     // first frame after the last touch, -1 if none yet
+static display_frame_t s_frame;
+
+static int s_max_boot_us = 500000;
+static int s_max_touch_us = 50000;
+static int64_t s_boot_us;
+static int64_t s_touch_active_us;
+static int64_t s_touch_screen_off_us;
+
+static void on_frame_done(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (s_frame_done_us < 0) {
+        s_frame_done_us = esp_timer_get_time();
+        s_frame = *(display_frame_t *) data;
+    }
+    xSemaphoreGive(s_frame_done);
+}
+
+static void check_clean_buses(void)
+{
+    emu_lcd_stats_t lcd;
+    emu_lcd_get_stats(&lcd);
+    TEST_CHECK_EQ(0, lcd.errors);
+    TEST_CHECK_EQ(0, lcd.timing_violations);
+    TEST_CHECK_EQ(0, lcd.hidden_pixels);
+    emu_rtc_stats_t rtc;
+    emu_rtc_get_stats(&rtc);
+    TEST_CHECK_EQ(0, rtc.errors);
+    TEST_CHECK_EQ(0, rtc.nacks);
+}
+
+static int lit_pixels(void)
+{
+    int count = 0;
+    for (int y = 0; y < EMU_LCD_PANEL_HEIGHT; ++y) {
+        for (int x = 0; x < EMU_LCD_PANEL_WIDTH; ++x) {
+            count += emu_lcd_panel_pixel(x, y) != 0;
+        }
+    }
+    return count;
+}
+
+/* Touch and wait for the first frame drawn after it; returns the time from
+ * the release to the frame being sent, -1 if nothing was drawn.
+ */
+static int64_t touch_to_redraw(void)
+{
+    s_frame_done_us = -1;
+    xSemaphoreTake(s_frame_done, 0);
+    int64_t release_us = emu_board_touch(TOUCH_HOLD_MS);
+    if (xSemaphoreTake(s_frame_done, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return -1;
+    }
+    return s_frame_done_us - release_us;
+}
+
+/* Cold boot: RTC read, LCD initialized and the time screen shown */
+static void test_boot(void)
+{
+    app_main();
+    s_boot_us = boot_profile_get("first_pixel");
+    TEST_CHECK(s_boot_us > 0);
+    TEST_CHECK_EQ(s_boot_us, emu_board_backlight_on_us());
+    TEST_CHECK(emu_lcd_state()->display_on);
+    TEST_CHECK(!emu_lcd_state()->sleeping);
+    TEST_CHECK(lit_pixels() > 0);
+    TEST_CHECK_EQ(100, emu_board_brightness());
+    TEST_CHECK_EQ(POWER_STATE_ACTIVE, power_state_get());
+    TEST_CHECK_EQ(1, emu_pm_lock_count(ESP_PM_NO_LIGHT_SLEEP));
+
+    // the system time is the one read from the RTC
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    TEST_CHECK_EQ(12, tm.tm_hour);
+    TEST_CHECK_EQ(59, tm.tm_min);
+    TEST_CHECK_EQ(120, tm.tm_year);
+    check_clean_buses();
+
+    s_frame_done = xSemaphoreCreateBinary();
+    ESP_ERROR_CHECK(esp_event_handler_register(DISPLAY_EVENT, DISPLAY_FRAME_DONE, &on_frame_done, NULL));
+}
+
+/* Touch while the screen is on: a frame is sent, with nothing to redraw
+ * as the minute hasn't changed
+ */
+static void test_touch_active(void)
+{
+    s_touch_active_us = touch_to_redraw();
+    TEST_CHECK(s_touch_active_us >= 0);
+    TEST_CHECK_EQ(1, s_frame.frame);
+    TEST_CHECK_EQ(POWER_STATE_ACTIVE, power_state_get());
+    check_clean_buses();
+}
+
+/* Without touches the screen dims, then turns off and lets the CPU sleep */
+static void test_timeouts(void)
+{
+    power_config_t config = POWER_CONFIG_DEFAULT();
+    int active_ms = config.timeout_ms[POWER_STATE_ACTIVE];
+    int dimmed_ms = config.timeout_ms[POWER_STATE_DIMMED];
+
+    vTaskDelay(pdMS_TO_TICKS(active_ms + 100));
+    TEST_CHECK_EQ(POWER_STATE_DIMMED, power_state_get());
+    TEST_CHECK_EQ(20, emu_board_brightness());
+    TEST_CHECK_EQ(1, emu_pm_lock_count(ESP_PM_NO_LIGHT_SLEEP));
+    TEST_CHECK_EQ(0, emu_pm_lock_count(ESP_PM_CPU_FREQ_MAX));
+
+    vTaskDelay(pdMS_TO_TICKS(dimmed_ms));
+    TEST_CHECK_EQ(POWER_STATE_SCREEN_OFF, power_state_get());
+    TEST_CHECK_EQ(0, emu_board_brightness());
+    TEST_CHECK_EQ(0, emu_pm_lock_count(ESP_PM_NO_LIGHT_SLEEP));
+}
+
+/* Touch with the screen off: back to the active state, with the time which
+ * has changed since the last frame
+ */
+static void test_touch_screen_off(void)
+{
+    s_touch_screen_off_us = touch_to_redraw();
+    TEST_CHECK(s_touch_screen_off_us >= 0);
+    TEST_CHECK_EQ(2, s_frame.frame);
+    TEST_CHECK_EQ(POWER_STATE_ACTIVE, power_state_get());
+    TEST_CHECK_EQ(100, emu_board_brightness());
+    TEST_CHECK_EQ(1, emu_pm_lock_count(ESP_PM_NO_LIGHT_SLEEP));
+    TEST_CHECK_EQ(1, emu_pm_lock_count(ESP_PM_CPU_FREQ_MAX));
+    check_clean_buses();
+}
+
+/* After the last timeout the LCD is put to sleep, then the board */
+static void test_deep_sleep(void)
+{
+    power_config_t config = POWER_CONFIG_DEFAULT();
+    int total_ms = config.timeout_ms[POWER_STATE_ACTIVE] + config.timeout_ms[POWER_STATE_DIMMED] +
+                   config.timeout_ms[POWER_STATE_SCREEN_OFF];
+    vTaskDelay(pdMS_TO_TICKS(total_ms + 100));
+    TEST_CHECK_EQ(POWER_STATE_DEEP_SLEEP, power_state_get());
+    TEST_CHECK(emu_board_sleep_us() > 0);
+    TEST_CHECK(emu_lcd_state()->sleeping);
+    check_clean_buses();
+}
+
+static void report(void)
+{
+    emu_lcd_stats_t lcd;
+    emu_lcd_get_stats(&lcd);
+    emu_rtc_stats_t rtc;
+    emu_rtc_get_stats(&rtc);
+    printf("emulated clock: LCD delays and bus transfers, not the code itself\n");
+    printf("%-32s %8d us (max %d)\n", "boot-to-first-pixel", (int) s_boot_us, s_max_boot_us);
+    printf("%-32s %8d us (max %d)\n", "touch-to-redraw, screen on", (int) s_touch_active_us,
+           s_max_touch_us);
+    printf("%-32s %8d us (max %d)\n", "touch-to-redraw, screen off", (int) s_touch_screen_off_us,
+           s_max_touch_us);
+    printf("%-32s %8u bytes, %u pixels\n", "LCD", (unsigned) lcd.bytes, (unsigned) lcd.pixels);
+    printf("%-32s %8u transfers, %u bytes\n", "RTC", (unsigned) rtc.transfers, (unsigned) rtc.bytes);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        s_max_boot_us = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_max_touch_us = atoi(argv[2]);
+    }
+    // the RTC keeps local time, which is UTC as on the board
+    setenv("TZ", "UTC0", 1);
+    tzset();
+    emu_set_virtual_clock(true);
+    emu_lcd_reset();
+    emu_rtc_reset();
+    // Sunday 2020-05-17 12:59:57, the minute changes while the screen is off
+    const uint8_t time_regs[] = { 0x57, 0x59, 0x12, 0x17, 0x00, 0x05, 0x20 };
+    for (int i = 0; i < sizeof(time_regs); ++i) {
+        emu_rtc_set_reg(0x02 + i, time_regs[i]);
+    }
+
+    TEST_RUN(test_boot);
+    TEST_RUN(test_touch_active);
+    TEST_RUN(test_timeouts);
+    TEST_RUN(test_touch_screen_off);
+    TEST_RUN(test_deep_sleep);
+
+    report();
+    TEST_CHECK(s_boot_us <= s_max_boot_us);
+    TEST_CHECK(s_touch_active_us <= s_max_touch_us);
+    TEST_CHECK(s_touch_screen_off_us <= s_max_touch_us);
+    return TEST_RESULT();
+}
@@ -0,0 +1,257 @@
+/**
+ *  Tests of reading the asset pack, with packs built in memory.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "idf_emu.h"
+#include "test_util.h"
+// built in, to map a different pack in each test
+#include "assets.c"
+
+#define PACK_MAX    1024
+
+typedef struct {
+    uint8_t data[PACK_MAX];
+    assets_header_t *header;
+    size_t size;
+} pack_t;
+
+static void pack_init(pack_t *pack, int count)
+{
+    memset(pack, 0, sizeof(*pack));
+    pack->header = (assets_header_t *) pack->data;
+    pack->header->magic = ASSETS_MAGIC;
+    pack->header->version = ASSETS_VERSION;
+    pack->header->count = count;
+    pack->size = sizeof(assets_header_t) + count * sizeof(assets_entry_t);
+    pack->header->size = pack->size;
+}
+
+static assets_entry_t *pack_entry(pack_t *pack, int index)
+{
+    return &((assets_entry_t *) (pack->header + 1))[index];
+}
+
+/* Append the data of entry 'index', aligned as mkassets.py does */
+static void pack_add(pack_t *pack, int index, const char *name, asset_type_t type,
+                     const void *data, size_t size)
+{
+    assets_entry_t *entry = pack_entry(pack, index);
+    strncpy(entry->name, name, ASSETS_NAME_LEN);
+    entry->type = type;
+    entry->offset = pack->size;
+    entry->size = size;
+    memcpy(pack->data + pack->size, data, size);
+    pack->size = (pack->size + size + 3) & ~3;
+    pack->header->size = pack->size;
+}
+
+/* Write the pack into the partition, and forget the one mapped before */
+static esp_err_t pack_load(const pack_t *pack)
+{
+    if (s_header != NULL) {
+        spi_flash_munmap(s_mmap_handle);
+        s_header = NULL;
+    }
+    s_init_done = false;
+    emu_partition_load(pack->data, pack->size);
+    return assets_init();
+}
+
+static const uint8_t s_font[4 + 3 * 2] = { 8, 2, 'a', 3, 0x80, 0x01, 0x40, 0x02, 0x20, 0x04 };
+static const uint8_t s_image[4 + 2 * 1 * 2] = { 2, 0, 1, 0, 0x12, 0x34, 0x56, 0x78 };
+static const uint8_t s_qoi[14 + 8] = {
+    'q', 'o', 'i', 'f', 0, 0, 0, 3, 0, 0, 0, 2, 3, 0,
+    0, 0, 0, 0, 0, 0, 0, 1,
+};
+
+static void make_valid(pack_t *pack)
+{
+    pack_init(pack, 3);
+    pack_add(pack, 0, "time", ASSET_TYPE_FONT, s_font, sizeof(s_font));
+    pack_add(pack, 1, "hello", ASSET_TYPE_IMAGE, s_image, sizeof(s_image));
+    pack_add(pack, 2, "logo", ASSET_TYPE_QOI, s_qoi, sizeof(s_qoi));
+}
+
+static void test_valid(void)
+{
+    pack_t pack;
+    make_valid(&pack);
+    TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+    TEST_CHECK_EQ(1, emu_partition_mmap_count());
+
+    asset_font_t font;
+    TEST_CHECK_EQ(ESP_OK, assets_get_font("time", &font));
+    TEST_CHECK_EQ(8, font.width);
+    TEST_CHECK_EQ(2, font.height);
+    TEST_CHECK_EQ(0x40, asset_font_glyph(&font, 'b')[0]);
+    TEST_CHECK_EQ(0x04, asset_font_glyph(&font, 'c')[1]);
+    TEST_CHECK(asset_font_glyph(&font, 'd') == NULL);
+    TEST_CHECK(asset_font_glyph(&font, ' ') == NULL);
+
+    asset_image_t image;
+    TEST_CHECK_EQ(ESP_OK, assets_get_image("hello", &image));
+    TEST_CHECK_EQ(2, image.width);
+    TEST_CHECK_EQ(1, image.height);
+    TEST_CHECK(image.pixels != NULL && image.qoi == NULL);
+    TEST_CHECK_EQ(0, memcmp(image.pixels, s_image + 4, 4));
+
+    // compressed images are found by the same function
+    TEST_CHECK_EQ(ESP_OK, assets_get_image("logo", &image));
+    TEST_CHECK_EQ(3, image.width);
+    TEST_CHECK_EQ(2, image.height);
+    TEST_CHECK(image.pixels == NULL);
+    TEST_CHECK_EQ(sizeof(s_qoi), image.qoi_size);
+
+    // names and types must both match
+    TEST_CHECK_EQ(ESP_ERR_NOT_FOUND, assets_get_font("hello", &font));
+    TEST_CHECK_EQ(ESP_ERR_NOT_FOUND, assets_get_image("tim", &image));
+    TEST_CHECK_EQ(ESP_ERR_NOT_FOUND, assets_get_image("hello2", &image));
+}
+
+/* Name of the full length, without a terminating zero */
+static void test_long_name(void)
+{
+    pack_t pack;
+    pack_init(&pack, 1);
+    pack_add(&pack, 0, "0123456789abcdef", ASSET_TYPE_FONT, s_font, sizeof(s_font));
+    TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+    asset_font_t font;
+    TEST_CHECK_EQ(ESP_OK, assets_get_font("0123456789abcdef", &font));
+}
+
+static void test_no_pack(void)
+{
+    pack_t pack;
+    memset(&pack, 0xff, sizeof(pack));
+    pack.size = 0;
+    TEST_CHECK_EQ(ESP_ERR_NOT_FOUND, pack_load(&pack));
+
+    make_valid(&pack);
+    emu_partition_set_present(false);
+    TEST_CHECK_EQ(ESP_ERR_NOT_FOUND, pack_load(&pack));
+    emu_partition_set_present(true);
+
+    make_valid(&pack);
+    pack.header->version = ASSETS_VERSION + 1;
+    TEST_CHECK_EQ(ESP_ERR_INVALID_VERSION, pack_load(&pack));
+
+    // lookups fail without a pack
+    asset_font_t font;
+    TEST_CHECK_EQ(ESP_ERR_NOT_FOUND, assets_get_font("time", &font));
+    TEST_CHECK_EQ(0, emu_partition_mmap_count());
+}
+
+/* Packs with a broken header or index aren't used at all */
+static void test_bad_index(void)
+{
+    pack_t pack;
+
+    make_valid(&pack);
+    pack.header->size = 0x200000;
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    make_valid(&pack);
+    pack.header->size = sizeof(assets_header_t) + 2 * sizeof(assets_entry_t);
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    make_valid(&pack);
+    pack.header->count = 0xffff;
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    // data inside the index
+    make_valid(&pack);
+    pack_entry(&pack, 1)->offset = sizeof(assets_header_t);
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    make_valid(&pack);
+    pack_entry(&pack, 1)->offset += 2;
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    make_valid(&pack);
+    pack_entry(&pack, 2)->size += 4;
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    // data past the end of the pack, where the size left would wrap around
+    make_valid(&pack);
+    pack_entry(&pack, 0)->offset = pack.header->size + 4;
+    pack_entry(&pack, 0)->size = 0;
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    make_valid(&pack);
+    pack_entry(&pack, 0)->offset = 0xfffffffc;
+    pack_entry(&pack, 0)->size = 8;
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, pack_load(&pack));
+
+    // empty data at the very end is fine
+    make_valid(&pack);
+    pack_entry(&pack, 0)->offset = pack.header->size;
+    pack_entry(&pack, 0)->size = 0;
+    TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+
+    TEST_CHECK_EQ(1, emu_partition_mmap_count());
+}
+
+/* Assets whose own header doesn't fit their data */
+static void test_bad_assets(void)
+{
+    pack_t pack;
+    asset_font_t font;
+    asset_image_t image;
+
+    make_valid(&pack);
+    pack_entry(&pack, 0)->size = 3;
+    pack_entry(&pack, 1)->size = 3;
+    TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_font("time", &font));
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_image("hello", &image));
+
+    make_valid(&pack);
+    pack_entry(&pack, 0)->size -= 1;
+    pack_entry(&pack, 1)->size -= 1;
+    pack_entry(&pack, 2)->size = 13;
+    TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_font("time", &font));
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_image("hello", &image));
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_image("logo", &image));
+
+    // image sizes whose size in bytes doesn't fit in an int
+    const uint16_t sizes[][2] = { { 0xffff, 0xffff }, { 0x8000, 0x8000 }, { 0xffff, 0x8001 } };
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        make_valid(&pack);
+        uint8_t *header = pack.data + pack_entry(&pack, 1)->offset;
+        header[0] = sizes[i][0] & 0xff;
+        header[1] = sizes[i][0] >> 8;
+        header[2] = sizes[i][1] & 0xff;
+        header[3] = sizes[i][1] >> 8;
+        TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+        TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_image("hello", &image));
+    }
+
+    // sizes which don't fit in 16 bits
+    make_valid(&pack);
+    pack.data[pack_entry(&pack, 2)->offset + 5] = 1;
+    TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_image("logo", &image));
+
+    make_valid(&pack);
+    pack.data[pack_entry(&pack, 2)->offset] = 'Q';
+    TEST_CHECK_EQ(ESP_OK, pack_load(&pack));
+    TEST_CHECK_EQ(ESP_ERR_INVALID_SIZE, assets_get_image("logo", &image));
+}
+
+int main(void)
+{
+    TEST_RUN(test_valid);
+    TEST_RUN(test_long_name);
+    TEST_RUN(test_no_pack);
+    TEST_RUN(test_bad_index);
+    TEST_RUN(test_bad_assets);
+    pack_load(&(pack_t) { .size = 0 });
+    TEST_CHECK_EQ(0, emu_partition_mmap_count());
+    return TEST_RESULT();
+}
@@ -0,0 +1,238 @@
+/**
+ *  Tests of the st7735 driver and the time screen on the emulated LCD.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "display.h"
+#include "st7735.h"
+#include "lcd_emu.h"
+#include "idf_emu.h"
+#include "test_util.h"
+
+#define SCREEN_PIXELS (EMU_LCD_PANEL_WIDTH * EMU_LCD_PANEL_HEIGHT)
+
+static const struct tm s_tm = {
+    .tm_year = 120, .tm_mon = 4, .tm_mday = 17, .tm_wday = 0,
+    .tm_hour = 12, .tm_min = 59, .tm_sec = 0
+};
+
+static void capture(uint16_t *pixels)
+{
+    for (int y = 0; y < emu_lcd_height(); ++y) {
+        for (int x = 0; x < emu_lcd_width(); ++x) {
+            *(pixels++) = emu_lcd_pixel(x, y);
+        }
+    }
+}
+
+static void check_clean_bus(void)
+{
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.errors);
+    TEST_CHECK_EQ(0, stats.hidden_pixels);
+    TEST_CHECK_EQ(0, stats.timing_violations);
+}
+
+static void test_init(void)
+{
+    display_init();
+    display_wait_ready();
+    const emu_lcd_state_t *state = emu_lcd_state();
+    TEST_CHECK(!state->sleeping);
+    // turned on by the first update, so that the GRAM contents aren't shown
+    TEST_CHECK(!state->display_on);
+    TEST_CHECK(!state->idle);
+#if CONFIG_ST7735_COLOR_12BIT
+    TEST_CHECK_EQ(3, state->colmod);
+#else
+    TEST_CHECK_EQ(5, state->colmod);
+#endif
+    TEST_CHECK_EQ(st7735_width(), emu_lcd_width());
+    TEST_CHECK_EQ(st7735_height(), emu_lcd_height());
+    check_clean_bus();
+}
+
+/* Clearing the screen reaches every pixel of the panel, in the wire byte order */
+static void test_clear_screen(void)
+{
+    const uint16_t color = 0x1f00;
+    st7735_clear_screen(color);
+    st7735_update_screen();
+    display_flush();
+    int wrong = 0;
+    for (int y = 0; y < EMU_LCD_PANEL_HEIGHT; ++y) {
+        for (int x = 0; x < EMU_LCD_PANEL_WIDTH; ++x) {
+            wrong += emu_lcd_panel_pixel(x, y) != 0x001f;
+        }
+    }
+    TEST_CHECK_EQ(0, wrong);
+    TEST_CHECK(emu_lcd_state()->display_on);
+    check_clean_bus();
+}
+
+/* Updating the time screen only redraws what changed; the result has to
+ * be the same as drawing the new time on a fresh screen.
+ */
+static void test_time_update(void)
+{
+    static uint16_t updated[SCREEN_PIXELS];
+    static uint16_t full[SCREEN_PIXELS];
+    struct tm tm = s_tm;
+
+    display_invalidate();
+    display_time(&tm);
+    display_flush();
+    emu_lcd_reset_stats();
+    tm.tm_hour = 13;
+    tm.tm_min = 0;
+    display_time(&tm);
+    display_flush();
+    capture(updated);
+    emu_lcd_stats_t update_stats;
+    emu_lcd_get_stats(&update_stats);
+
+    st7735_clear_screen(0);
+    st7735_update_screen();
+    display_invalidate();
+    emu_lcd_reset_stats();
+    display_time(&tm);
+    display_flush();
+    capture(full);
+    emu_lcd_stats_t full_stats;
+    emu_lcd_get_stats(&full_stats);
+
+    TEST_CHECK(memcmp(updated, full, sizeof(full)) == 0);
+    TEST_CHECK(update_stats.pixels < full_stats.pixels);
+    check_clean_bus();
+}
+
+/* Statistics of the driver match what the LCD has received */
+static void test_stats(void)
+{
+    struct tm tm = s_tm;
+    st7735_stats_t stats;
+    emu_lcd_stats_t emu_stats;
+
+    display_flush();
+    st7735_reset_stats();
+    emu_lcd_reset_stats();
+    display_invalidate();
+    display_time(&tm);
+    display_flush();
+    st7735_get_stats(&stats);
+    emu_lcd_get_stats(&emu_stats);
+    TEST_CHECK_EQ(emu_stats.transactions, stats.transactions);
+    TEST_CHECK_EQ(emu_stats.commands, stats.commands);
+    TEST_CHECK_EQ(emu_stats.bytes, stats.bytes);
+}
+
+/* Sleep and wake up, as from deep sleep: the LCD keeps showing the time
+ * screen, and later updates of it only draw what has changed.
+ */
+static void test_sleep_wake(void)
+{
+    static uint16_t before[SCREEN_PIXELS];
+    static uint16_t after[SCREEN_PIXELS];
+    struct tm tm = s_tm;
+
+    display_invalidate();
+    display_time(&tm);
+    display_flush();
+    capture(before);
+
+    display_sleep();
+    TEST_CHECK(emu_lcd_state()->sleeping);
+    emu_set_wakeup_cause(ESP_SLEEP_WAKEUP_EXT1);
+    display_init();
+    display_wait_ready();
+    TEST_CHECK(!emu_lcd_state()->sleeping);
+    // straight back to sleep, which has to wait after SLPOUT
+    display_sleep();
+    display_init();
+    display_wait_ready();
+    capture(after);
+    TEST_CHECK(memcmp(before, after, sizeof(after)) == 0);
+
+    emu_lcd_reset_stats();
+    tm.tm_min++;
+    display_time(&tm);
+    display_flush();
+    capture(after);
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    TEST_CHECK(stats.pixels < SCREEN_PIXELS / 2);
+
+    display_invalidate();
+    display_time(&tm);
+    display_flush();
+    capture(before);
+    TEST_CHECK(memcmp(before, after, sizeof(after)) == 0);
+    emu_set_wakeup_cause(ESP_SLEEP_WAKEUP_UNDEFINED);
+    check_clean_bus();
+}
+
+/* Each rotation turns the screen by a quarter turn clockwise: the origin
+ * moves to the corner of the panel where the end of the x axis was.
+ */
+static void test_rotation(void)
+{
+    static const struct {
+        int x, y;
+    } s_origins[] = {
+        [ST7735_ROTATION_0] = { 0, EMU_LCD_PANEL_HEIGHT - 1 },
+        [ST7735_ROTATION_90] = { 0, 0 },
+        [ST7735_ROTATION_180] = { EMU_LCD_PANEL_WIDTH - 1, 0 },
+        [ST7735_ROTATION_270] = { EMU_LCD_PANEL_WIDTH - 1, EMU_LCD_PANEL_HEIGHT - 1 },
+    };
+    const uint16_t origin_color = 0x00f8;
+    const uint16_t x_end_color = 0xe007;
+
+    for (int rotation = ST7735_ROTATION_0; rotation <= ST7735_ROTATION_270; ++rotation) {
+        // leave some regions to be sent in the previous rotation
+        st7735_fill_rect(st7735_width() - 4, st7735_width() - 1, 0, 3, 0xffff);
+        st7735_fill_rect(0, 3, st7735_height() - 4, st7735_height() - 1, 0xffff);
+        st7735_set_rotation(rotation);
+        st7735_clear_screen(0);
+        st7735_draw_pixel(0, 0, origin_color);
+        st7735_draw_pixel(st7735_width() - 1, 0, x_end_color);
+        st7735_update_screen();
+        display_flush();
+        TEST_CHECK_EQ(st7735_width(), emu_lcd_width());
+        TEST_CHECK_EQ(st7735_height(), emu_lcd_height());
+        int next = (rotation + 1) % 4;
+        TEST_CHECK_EQ(0xf800, emu_lcd_panel_pixel(s_origins[rotation].x, s_origins[rotation].y));
+        TEST_CHECK_EQ(0x07e0, emu_lcd_panel_pixel(s_origins[next].x, s_origins[next].y));
+        // logical coordinates of the driver and of the LCD agree
+        TEST_CHECK_EQ(0xf800, emu_lcd_pixel(0, 0));
+        TEST_CHECK_EQ(0x07e0, emu_lcd_pixel(st7735_width() - 1, 0));
+
+        // window has to be within the screen
+        TEST_CHECK(st7735_set_window(0, st7735_width() - 1, 0, st7735_height() - 1));
+        TEST_CHECK(!st7735_set_window(0, st7735_width(), 0, 0));
+        TEST_CHECK(!st7735_set_window(0, 0, 0, st7735_height()));
+    }
+    st7735_set_rotation(ST7735_ROTATION_0);
+    check_clean_bus();
+}
+
+int main(int argc, char **argv)
+{
+    emu_lcd_reset();
+    TEST_RUN(test_init);
+    TEST_RUN(test_clear_screen);
+    TEST_RUN(test_time_update);
+    TEST_RUN(test_stats);
+    TEST_RUN(test_sleep_wake);
+    TEST_RUN(test_rotation);
+    if (argc > 1) {
+        emu_lcd_dump_ppm(argv[1]);
+    }
+    return TEST_RESULT();
+}
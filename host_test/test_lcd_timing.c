@@ -0,0 +1,83 @@
+/**
+ *  Tests of the command timing of the st7735 driver, on the emulated LCD.
+ *
+ *  Built with the datasheet delays, and with the delays scaled down by
+ *  CONFIG_ST7735_INIT_DELAY_PERCENT, which the emulator has to catch.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "display.h"
+#include "st7735.h"
+#include "lcd_emu.h"
+#include "test_util.h"
+
+// SWRESET -> SLPOUT, then SLPOUT -> any command
+#define INIT_MIN_US     ((120000 + 5000) * CONFIG_ST7735_INIT_DELAY_PERCENT / 100)
+// allowance for the time spent running the code between the delays
+#define SLACK_US        20000
+
+static void check_violations(void)
+{
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.errors);
+#if CONFIG_ST7735_INIT_DELAY_PERCENT < 100
+    TEST_CHECK(stats.timing_violations > 0);
+#else
+    TEST_CHECK_EQ(0, stats.timing_violations);
+#endif
+    emu_lcd_reset_stats();
+}
+
+/* The init sequence takes the required delays, and not much longer */
+static void test_init(void)
+{
+    int64_t start = esp_timer_get_time();
+    display_init();
+    display_wait_ready();
+    int64_t duration = esp_timer_get_time() - start;
+    TEST_CHECK(duration >= INIT_MIN_US);
+    TEST_CHECK(duration < INIT_MIN_US + SLACK_US);
+    check_violations();
+}
+
+/* Drawing starts while the init sequence is in progress */
+static void test_draw_during_init(void)
+{
+    const struct tm tm = {
+        .tm_year = 120, .tm_mon = 4, .tm_mday = 17, .tm_hour = 12, .tm_min = 59
+    };
+    display_init();
+    display_invalidate();
+    display_time(&tm);
+    display_flush();
+    TEST_CHECK(!emu_lcd_state()->sleeping);
+    TEST_CHECK(emu_lcd_state()->display_on);
+    check_violations();
+}
+
+/* Sleep right after waking up, and wake up right after sleeping */
+static void test_sleep_wake(void)
+{
+    st7735_sleep();
+    TEST_CHECK(emu_lcd_state()->sleeping);
+    st7735_init_warm();
+    TEST_CHECK(!emu_lcd_state()->sleeping);
+    st7735_sleep();
+    st7735_init_warm();
+    check_violations();
+}
+
+int main(void)
+{
+    emu_lcd_reset();
+    TEST_RUN(test_init);
+    TEST_RUN(test_draw_during_init);
+    TEST_RUN(test_sleep_wake);
+    return TEST_RESULT();
+}
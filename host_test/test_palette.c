@@ -0,0 +1,143 @@
+/**
+ *  Tests of the palette framebuffer formats, on the emulated LCD.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include "display.h"
+#include "st7735.h"
+#include "lcd_emu.h"
+#include "test_util.h"
+
+#if CONFIG_ST7735_FB_4BPP
+#define PALETTE_LEN 16
+#else
+#define PALETTE_LEN 256
+#endif
+
+// distinct colors, in the byte order used by the drawing functions
+static uint16_t color(int i)
+{
+    uint16_t c = (uint16_t) (0x0841 * (i % 31 + 1) + 0x20 * (i / 31));
+    return (c >> 8) | (c << 8);
+}
+
+// color as read from the emulated LCD
+static uint16_t lcd_color(uint16_t c)
+{
+    return (c >> 8) | (c << 8);
+}
+
+/* Every full redraw can use as many colors as the palette has */
+static void test_full_redraws(void)
+{
+    const int colors_per_screen = PALETTE_LEN - 1;
+    for (int screen = 0; screen < 4; ++screen) {
+        int first = screen * colors_per_screen;
+        st7735_clear_screen(color(first));
+        for (int i = 1; i < colors_per_screen; ++i) {
+            st7735_fill_rect(i % 80, i % 80, i / 80, i / 80, color(first + i));
+        }
+        st7735_update_screen();
+        display_flush();
+        TEST_CHECK_EQ(lcd_color(color(first)), emu_lcd_pixel(0, 0));
+        for (int i = 1; i < colors_per_screen; ++i) {
+            TEST_CHECK_EQ(lcd_color(color(first + i)), emu_lcd_pixel(i % 80, i / 80));
+        }
+    }
+}
+
+/* Colors no longer on the screen make room for new ones */
+static void test_reuse(void)
+{
+    const uint16_t bg = 0xffff;
+    st7735_clear_screen(bg);
+    // fill up the palette, with black still in it
+    for (int i = 0; i < PALETTE_LEN - 2; ++i) {
+        st7735_fill_rect(i % 40 * 4, i % 40 * 4 + 3, i / 40 * 4, i / 40 * 4 + 3, color(i));
+    }
+    st7735_update_screen();
+    for (int i = 0; i < 8; ++i) {
+        // erase a rectangle, then draw it with a new color
+        int x = i * 4;
+        st7735_fill_rect(x, x + 3, 0, 3, bg);
+        st7735_fill_rect(x, x + 3, 0, 3, color(PALETTE_LEN + i));
+        st7735_update_screen();
+        display_flush();
+        TEST_CHECK_EQ(lcd_color(color(PALETTE_LEN + i)), emu_lcd_pixel(x + 1, 1));
+    }
+    // the rest is unchanged
+    for (int i = 8; i < PALETTE_LEN - 2; ++i) {
+        TEST_CHECK_EQ(lcd_color(color(i)), emu_lcd_pixel(i % 40 * 4, i / 40 * 4));
+    }
+}
+
+static int s_screen_pixels[EMU_LCD_PANEL_WIDTH * EMU_LCD_PANEL_HEIGHT];
+
+static void capture(void)
+{
+    int *p = s_screen_pixels;
+    for (int y = 0; y < emu_lcd_height(); ++y) {
+        for (int x = 0; x < emu_lcd_width(); ++x) {
+            *(p++) = emu_lcd_pixel(x, y);
+        }
+    }
+}
+
+static int count_changed(void)
+{
+    int changed = 0;
+    int *p = s_screen_pixels;
+    for (int y = 0; y < emu_lcd_height(); ++y) {
+        for (int x = 0; x < emu_lcd_width(); ++x) {
+            changed += *(p++) != emu_lcd_pixel(x, y);
+        }
+    }
+    return changed;
+}
+
+/* Anti-aliased time screen, updated every minute for a day. The hands
+ * drawn over an hour of updates look the same as when drawn on a fresh
+ * screen: the colors of the old hands are reused for the new ones.
+ */
+static void test_analog_day(void)
+{
+    struct tm tm = {
+        .tm_year = 120, .tm_mon = 4, .tm_mday = 17, .tm_hour = 0, .tm_min = 0
+    };
+    int max_changed = 0;
+    display_invalidate();
+    for (int minutes = 0; minutes < 24 * 60; ++minutes) {
+        tm.tm_hour = minutes / 60;
+        tm.tm_min = minutes % 60;
+        display_time(&tm);
+        if (tm.tm_min == 59) {
+            display_flush();
+            capture();
+            display_invalidate();
+            display_time(&tm);
+            display_flush();
+            int changed = count_changed();
+            max_changed = changed > max_changed ? changed : max_changed;
+        }
+    }
+    TEST_CHECK_EQ(0, max_changed);
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.errors);
+    TEST_CHECK_EQ(0, stats.hidden_pixels);
+}
+
+int main(void)
+{
+    emu_lcd_reset();
+    display_init();
+    display_wait_ready();
+    TEST_RUN(test_full_redraws);
+    TEST_RUN(test_reuse);
+    TEST_RUN(test_analog_day);
+    return TEST_RESULT();
+}
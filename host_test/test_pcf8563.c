@@ -0,0 +1,315 @@
+/**
+ *  Tests of the PCF8563 driver and the I2C transfers, on the emulated RTC.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "i2c_bus.h"
+#include "pcf8563.h"
+#include "idf_emu.h"
+#include "rtc_emu.h"
+#include "test_util.h"
+
+#define I2C_PORT    I2C_NUM_0
+
+static SemaphoreHandle_t s_async_done;
+static struct tm s_async_tm;
+static esp_err_t s_async_err;
+static TaskHandle_t s_async_task;
+
+static uint32_t transfers(void)
+{
+    emu_rtc_stats_t stats;
+    emu_rtc_get_stats(&stats);
+    emu_rtc_reset_stats();
+    return stats.transfers;
+}
+
+static void check_clean_bus(void)
+{
+    emu_rtc_stats_t stats;
+    emu_rtc_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.errors);
+    TEST_CHECK_EQ(0, stats.nacks);
+}
+
+static void check_tm(const struct tm *expected, const struct tm *actual)
+{
+    TEST_CHECK_EQ(expected->tm_sec, actual->tm_sec);
+    TEST_CHECK_EQ(expected->tm_min, actual->tm_min);
+    TEST_CHECK_EQ(expected->tm_hour, actual->tm_hour);
+    TEST_CHECK_EQ(expected->tm_mday, actual->tm_mday);
+    TEST_CHECK_EQ(expected->tm_mon, actual->tm_mon);
+    TEST_CHECK_EQ(expected->tm_year, actual->tm_year);
+    TEST_CHECK_EQ(expected->tm_wday, actual->tm_wday);
+}
+
+static void test_init(void)
+{
+    emu_rtc_reset();
+    TEST_CHECK_EQ(ESP_OK, i2c_bus_init(I2C_PORT, 21, 22, 400000));
+    pcf8563_init(I2C_PORT);
+    // only checks that the chip responds
+    TEST_CHECK_EQ(1, transfers());
+    check_clean_bus();
+}
+
+/* Registers are BCD, the month register holds the century bit */
+static void test_set_time(void)
+{
+    const struct tm tm = {
+        .tm_year = 120, .tm_mon = 4, .tm_mday = 17, .tm_wday = 0,
+        .tm_hour = 12, .tm_min = 59, .tm_sec = 7
+    };
+    pcf8563_set_time(&tm);
+    TEST_CHECK_EQ(1, transfers());
+    const uint8_t expected[] = { 0x07, 0x59, 0x12, 0x17, 0x00, 0x05, 0x20 };
+    for (int i = 0; i < sizeof(expected); ++i) {
+        TEST_CHECK_EQ(expected[i], emu_rtc_reg(0x02 + i));
+    }
+
+    struct tm out;
+    pcf8563_get_time(&out);
+    TEST_CHECK_EQ(1, transfers());
+    check_tm(&tm, &out);
+    check_clean_bus();
+}
+
+static void test_century(void)
+{
+    const struct tm dates[] = {
+        { .tm_year = 100, .tm_mon = 0, .tm_mday = 1, .tm_wday = 6 },
+        { .tm_year = 199, .tm_mon = 11, .tm_mday = 31, .tm_wday = 4,
+          .tm_hour = 23, .tm_min = 59, .tm_sec = 59 },
+        { .tm_year = 200, .tm_mon = 0, .tm_mday = 1, .tm_wday = 5 },
+        { .tm_year = 299, .tm_mon = 8, .tm_mday = 30, .tm_wday = 3,
+          .tm_hour = 9, .tm_min = 8, .tm_sec = 10 },
+    };
+    for (int i = 0; i < sizeof(dates) / sizeof(dates[0]); ++i) {
+        pcf8563_set_time(&dates[i]);
+        TEST_CHECK_EQ(dates[i].tm_year >= 200 ? 0x80 : 0, emu_rtc_reg(0x07) & 0x80);
+        TEST_CHECK_EQ((dates[i].tm_year % 100 / 10) << 4 | dates[i].tm_year % 10,
+                      emu_rtc_reg(0x08));
+        struct tm out;
+        pcf8563_get_time(&out);
+        check_tm(&dates[i], &out);
+    }
+    check_clean_bus();
+}
+
+/* Bits which aren't part of the values, e.g. the VL bit, are ignored */
+static void test_unused_bits(void)
+{
+    const uint8_t regs[] = { 0x80 | 0x45, 0x80 | 0x30, 0xc0 | 0x23, 0xc0 | 0x31,
+                             0xf8 | 0x06, 0x60 | 0x12, 0x99 };
+    for (int i = 0; i < sizeof(regs); ++i) {
+        emu_rtc_set_reg(0x02 + i, regs[i]);
+    }
+    struct tm out;
+    pcf8563_get_time(&out);
+    TEST_CHECK_EQ(45, out.tm_sec);
+    TEST_CHECK_EQ(30, out.tm_min);
+    TEST_CHECK_EQ(23, out.tm_hour);
+    TEST_CHECK_EQ(31, out.tm_mday);
+    TEST_CHECK_EQ(6, out.tm_wday);
+    TEST_CHECK_EQ(11, out.tm_mon);
+    TEST_CHECK_EQ(199, out.tm_year);
+    check_clean_bus();
+}
+
+static void test_alarm(void)
+{
+    transfers();
+    pcf8563_set_alarm(&(pcf8563_alarm_t) {
+        .minute = 30, .hour = -1, .day = -1, .weekday = -1
+    });
+    // alarm registers, then read-modify-write of CTRL2
+    TEST_CHECK_EQ(3, transfers());
+    TEST_CHECK_EQ(0x30, emu_rtc_reg(0x09));
+    TEST_CHECK_EQ(0x80, emu_rtc_reg(0x0a));
+    TEST_CHECK_EQ(0x80, emu_rtc_reg(0x0b));
+    TEST_CHECK_EQ(0x80, emu_rtc_reg(0x0c));
+    TEST_CHECK_EQ(0x02, emu_rtc_reg(0x01));
+    TEST_CHECK(!emu_rtc_int_active());
+
+    emu_rtc_alarm();
+    TEST_CHECK(emu_rtc_int_active());
+    TEST_CHECK_EQ(PCF8563_FLAG_ALARM, pcf8563_clear_flags());
+    TEST_CHECK(!emu_rtc_int_active());
+    // still enabled
+    TEST_CHECK_EQ(0x02, emu_rtc_reg(0x01));
+    TEST_CHECK_EQ(0, pcf8563_clear_flags());
+
+    pcf8563_set_alarm(&(pcf8563_alarm_t) {
+        .minute = 5, .hour = 7, .day = 31, .weekday = 6
+    });
+    TEST_CHECK_EQ(0x05, emu_rtc_reg(0x09));
+    TEST_CHECK_EQ(0x07, emu_rtc_reg(0x0a));
+    TEST_CHECK_EQ(0x31, emu_rtc_reg(0x0b));
+    TEST_CHECK_EQ(0x06, emu_rtc_reg(0x0c));
+
+    // setting the alarm clears a flag left from before
+    emu_rtc_alarm();
+    pcf8563_set_alarm(&(pcf8563_alarm_t) {
+        .minute = 6, .hour = -1, .day = -1, .weekday = -1
+    });
+    TEST_CHECK(!emu_rtc_int_active());
+
+    emu_rtc_alarm();
+    pcf8563_disable_alarm();
+    TEST_CHECK_EQ(0, emu_rtc_reg(0x01));
+    check_clean_bus();
+}
+
+static void test_timer(void)
+{
+    transfers();
+    pcf8563_set_timer(PCF8563_TIMER_1HZ, 60);
+    // value with the timer stopped, start, then read-modify-write of CTRL2
+    TEST_CHECK_EQ(4, transfers());
+    TEST_CHECK_EQ(0x82, emu_rtc_reg(0x0e));
+    TEST_CHECK_EQ(60, emu_rtc_reg(0x0f));
+    // timer interrupt enabled, INT follows TF instead of pulsing
+    TEST_CHECK_EQ(0x01, emu_rtc_reg(0x01));
+
+    emu_rtc_timer();
+    TEST_CHECK(emu_rtc_int_active());
+    TEST_CHECK_EQ(PCF8563_FLAG_TIMER, pcf8563_clear_flags());
+    TEST_CHECK(!emu_rtc_int_active());
+
+    // the reload value stays, only the control register is written
+    pcf8563_disable_timer();
+    TEST_CHECK_EQ(0x03, emu_rtc_reg(0x0e));
+    TEST_CHECK_EQ(60, emu_rtc_reg(0x0f));
+    TEST_CHECK_EQ(0, emu_rtc_reg(0x01));
+    emu_rtc_timer();
+    TEST_CHECK_EQ(0, pcf8563_clear_flags());
+
+    emu_rtc_set_reg(0x01, 0x10 | 0x04);
+    pcf8563_set_timer(PCF8563_TIMER_64HZ, 1);
+    TEST_CHECK_EQ(0x81, emu_rtc_reg(0x0e));
+    TEST_CHECK_EQ(1, emu_rtc_reg(0x0f));
+    TEST_CHECK_EQ(0x01, emu_rtc_reg(0x01));
+    pcf8563_disable_timer();
+    check_clean_bus();
+}
+
+/* Clearing one flag keeps the other one, and the interrupt enables */
+static void test_flags_kept(void)
+{
+    pcf8563_set_alarm(&(pcf8563_alarm_t) {
+        .minute = 0, .hour = -1, .day = -1, .weekday = -1
+    });
+    pcf8563_set_timer(PCF8563_TIMER_1_60HZ, 1);
+    emu_rtc_alarm();
+    emu_rtc_timer();
+    TEST_CHECK_EQ(0x0f, emu_rtc_reg(0x01));
+
+    pcf8563_disable_alarm();
+    TEST_CHECK_EQ(0x05, emu_rtc_reg(0x01));
+    TEST_CHECK(emu_rtc_int_active());
+    emu_rtc_alarm();
+    pcf8563_disable_timer();
+    TEST_CHECK_EQ(0x08, emu_rtc_reg(0x01));
+    // AF is set, but its interrupt is disabled
+    TEST_CHECK(!emu_rtc_int_active());
+    TEST_CHECK_EQ(PCF8563_FLAG_ALARM, pcf8563_clear_flags());
+    TEST_CHECK_EQ(0, emu_rtc_reg(0x01));
+    check_clean_bus();
+}
+
+/* The emulator catches a command link which is run twice, as it only works
+ * once with the driver before IDF 4.4
+ */
+static void test_link_reuse(void)
+{
+    uint8_t data[2];
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, EMU_RTC_ADDR << 1 | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, 0x00, true);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, EMU_RTC_ADDR << 1 | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, data, sizeof(data), I2C_MASTER_LAST_NACK);
+    i2c_master_stop(cmd);
+    TEST_CHECK_EQ(ESP_OK, i2c_master_cmd_begin(I2C_PORT, cmd, 1));
+    TEST_CHECK(i2c_master_cmd_begin(I2C_PORT, cmd, 1) != ESP_OK);
+    i2c_cmd_link_delete(cmd);
+    emu_rtc_stats_t stats;
+    emu_rtc_get_stats(&stats);
+    TEST_CHECK_EQ(1, stats.errors);
+    emu_rtc_reset_stats();
+
+    // a prepared transfer builds its link on every run
+    i2c_bus_xfer_t xfer;
+    i2c_bus_prepare_read(&xfer, I2C_PORT, EMU_RTC_ADDR, 0x00, data, sizeof(data));
+    for (int i = 0; i < 3; ++i) {
+        TEST_CHECK_EQ(ESP_OK, i2c_bus_run(&xfer));
+    }
+    // other devices don't respond
+    i2c_bus_prepare_read(&xfer, I2C_PORT, 0x19, 0x00, data, sizeof(data));
+    TEST_CHECK(i2c_bus_run(&xfer) != ESP_OK);
+    emu_rtc_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.errors);
+    TEST_CHECK_EQ(1, stats.nacks);
+    TEST_CHECK_EQ(4, stats.transfers);
+    emu_rtc_reset_stats();
+}
+
+static void on_time_read(const struct tm *tm, esp_err_t err, void *arg)
+{
+    s_async_tm = *tm;
+    s_async_err = err;
+    s_async_task = xTaskGetCurrentTaskHandle();
+    xSemaphoreGive(s_async_done);
+}
+
+/* The asynchronous read completes from the I2C task, one read at a time */
+static void test_get_time_async(void)
+{
+    const struct tm tm = {
+        .tm_year = 120, .tm_mon = 4, .tm_mday = 17, .tm_wday = 0,
+        .tm_hour = 12, .tm_min = 59, .tm_sec = 7
+    };
+    pcf8563_set_time(&tm);
+    transfers();
+    s_async_done = xSemaphoreCreateBinary();
+
+    TEST_CHECK_EQ(ESP_OK, pcf8563_get_time_async(&on_time_read, NULL));
+    // the I2C task is waiting for the bus meanwhile
+    TEST_CHECK_EQ(ESP_ERR_INVALID_STATE, pcf8563_get_time_async(&on_time_read, NULL));
+    TEST_CHECK(xSemaphoreTake(s_async_done, pdMS_TO_TICKS(100)) == pdTRUE);
+    TEST_CHECK_EQ(ESP_OK, s_async_err);
+    TEST_CHECK(s_async_task != xTaskGetCurrentTaskHandle());
+    check_tm(&tm, &s_async_tm);
+    TEST_CHECK_EQ(1, transfers());
+
+    // finished, the next read can start
+    TEST_CHECK_EQ(ESP_OK, pcf8563_get_time_async(&on_time_read, NULL));
+    TEST_CHECK(xSemaphoreTake(s_async_done, pdMS_TO_TICKS(100)) == pdTRUE);
+    TEST_CHECK_EQ(1, transfers());
+    check_clean_bus();
+}
+
+int main(void)
+{
+    // transfers take time, during which other tasks run
+    emu_set_virtual_clock(true);
+    TEST_RUN(test_init);
+    TEST_RUN(test_set_time);
+    TEST_RUN(test_century);
+    TEST_RUN(test_unused_bits);
+    TEST_RUN(test_alarm);
+    TEST_RUN(test_timer);
+    TEST_RUN(test_flags_kept);
+    TEST_RUN(test_link_reuse);
+    TEST_RUN(test_get_time_async);
+    return TEST_RESULT();
+}
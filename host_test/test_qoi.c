@@ -0,0 +1,427 @@
+/**
+ *  Tests of the QOI decoder of the st7735 driver: images encoded here are
+ *  decoded and drawn back, whole, in pieces and damaged.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "display.h"
+#include "st7735.h"
+#include "st7735_qoi.h"
+#include "lcd_emu.h"
+#include "test_util.h"
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t *rgba;
+    uint8_t *qoi;
+    size_t qoi_size;
+    // for each chunk: the offset of its end, and the number of pixels so far
+    size_t *chunk_end;
+    uint32_t *chunk_pixels;
+    int chunks;
+} image_t;
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void chunk_done(image_t *img, size_t end, uint32_t pixels)
+{
+    img->chunk_end[img->chunks] = end;
+    img->chunk_pixels[img->chunks] = pixels;
+    img->chunks++;
+}
+
+/* Encoder following the specification, with all of its ops */
+static void encode(image_t *img)
+{
+    uint32_t count = img->width * img->height;
+    img->qoi = malloc(14 + count * 5 + 8);
+    img->chunk_end = malloc(count * sizeof(size_t));
+    img->chunk_pixels = malloc(count * sizeof(uint32_t));
+    img->chunks = 0;
+    uint8_t *out = img->qoi;
+    memcpy(out, "qoif", 4);
+    put32(out + 4, img->width);
+    put32(out + 8, img->height);
+    out[12] = 4;
+    out[13] = 0;
+    size_t n = 14;
+
+    uint8_t index[64][4] = { { 0 } };
+    uint8_t prev[4] = { 0, 0, 0, 255 };
+    int run = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t *px = &img->rgba[i * 4];
+        if (memcmp(px, prev, 4) == 0) {
+            run++;
+            if (run == 62 || i == count - 1) {
+                out[n++] = 0xc0 | (run - 1);
+                chunk_done(img, n, i + 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run) {
+            out[n++] = 0xc0 | (run - 1);
+            chunk_done(img, n, i);
+            run = 0;
+        }
+        int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if (memcmp(index[hash], px, 4) == 0) {
+            out[n++] = hash;
+        } else {
+            memcpy(index[hash], px, 4);
+            if (px[3] == prev[3]) {
+                int8_t dr = px[0] - prev[0];
+                int8_t dg = px[1] - prev[1];
+                int8_t db = px[2] - prev[2];
+                int8_t dr_dg = dr - dg;
+                int8_t db_dg = db - dg;
+                if (dr >= -2 && dr < 2 && dg >= -2 && dg < 2 && db >= -2 && db < 2) {
+                    out[n++] = 0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+                } else if (dg >= -32 && dg < 32 && dr_dg >= -8 && dr_dg < 8 &&
+                           db_dg >= -8 && db_dg < 8) {
+                    out[n++] = 0x80 | (dg + 32);
+                    out[n++] = ((dr_dg + 8) << 4) | (db_dg + 8);
+                } else {
+                    out[n++] = 0xfe;
+                    memcpy(&out[n], px, 3);
+                    n += 3;
+                }
+            } else {
+                out[n++] = 0xff;
+                memcpy(&out[n], px, 4);
+                n += 4;
+            }
+        }
+        chunk_done(img, n, i + 1);
+        memcpy(prev, px, 4);
+    }
+    memcpy(&out[n], "\0\0\0\0\0\0\0\1", 8);
+    img->qoi_size = n + 8;
+}
+
+static uint16_t to_565(const uint8_t *px)
+{
+    uint16_t v = ((px[2] >> 3) << 11) | ((px[1] >> 2) << 5) | (px[0] >> 3);
+    return (v >> 8) | (v << 8);
+}
+
+static uint32_t s_seed = 1;
+
+static uint8_t random8(void)
+{
+    s_seed = s_seed * 1103515245 + 12345;
+    return s_seed >> 16;
+}
+
+typedef enum {
+    IMAGE_FLAT, IMAGE_GRADIENT, IMAGE_NOISE, IMAGE_FEW_COLORS, IMAGE_ALPHA, IMAGE_KINDS
+} image_kind_t;
+
+static const char *s_kind_names[] = { "flat", "gradient", "noise", "few colors", "alpha" };
+
+static void make_image(image_t *img, image_kind_t kind, uint32_t width, uint32_t height)
+{
+    memset(img, 0, sizeof(*img));
+    img->width = width;
+    img->height = height;
+    img->rgba = malloc(width * height * 4);
+    static const uint8_t colors[5][4] = {
+        { 255, 0, 0, 255 }, { 0, 0, 0, 255 }, { 10, 200, 30, 255 },
+        { 255, 255, 255, 255 }, { 1, 2, 3, 255 },
+    };
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t *px = &img->rgba[(y * width + x) * 4];
+            switch (kind) {
+            case IMAGE_FLAT:
+                // runs longer than a single chunk, and a change in the middle
+                memcpy(px, colors[(y > height / 2) ? 2 : 0], 4);
+                break;
+            case IMAGE_GRADIENT:
+                // small steps, and wrap around from 255 to 0
+                px[0] = x * 3 + y;
+                px[1] = x * 2 - y * 5;
+                px[2] = 250 + x;
+                px[3] = 255;
+                break;
+            case IMAGE_NOISE:
+                px[0] = random8();
+                px[1] = random8();
+                px[2] = random8();
+                px[3] = 255;
+                break;
+            case IMAGE_FEW_COLORS:
+                memcpy(px, colors[random8() % 5], 4);
+                if (random8() % 4 == 0) {
+                    memcpy(px, colors[4], 4);
+                    px[1] += random8() % 3;
+                }
+                break;
+            case IMAGE_ALPHA:
+                px[0] = random8() % 4;
+                px[1] = 100;
+                px[2] = 50;
+                px[3] = random8() % 2 ? 255 : 128;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    encode(img);
+}
+
+static void free_image(image_t *img)
+{
+    free(img->rgba);
+    free(img->qoi);
+    free(img->chunk_end);
+    free(img->chunk_pixels);
+}
+
+static int check_pixels(const image_t *img, const uint16_t *out, uint32_t start, uint32_t count)
+{
+    int wrong = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (out[i] != to_565(&img->rgba[(start + i) * 4])) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+static void test_header(void)
+{
+    image_t img;
+    make_image(&img, IMAGE_NOISE, 3, 2);
+    st7735_qoi_t qoi;
+    TEST_CHECK(st7735_qoi_init(&qoi, img.qoi, img.qoi_size));
+    TEST_CHECK_EQ(3, qoi.width);
+    TEST_CHECK_EQ(2, qoi.height);
+    TEST_CHECK(!st7735_qoi_init(&qoi, img.qoi, 14 + 7));
+
+    uint8_t bad[64];
+    memcpy(bad, img.qoi, 22);
+    memcpy(bad + 22, "\0\0\0\0\0\0\0\1", 8);
+    bad[0] = 'Q';
+    TEST_CHECK(!st7735_qoi_init(&qoi, bad, 30));
+    bad[0] = 'q';
+    put32(bad + 4, 0);
+    TEST_CHECK(!st7735_qoi_init(&qoi, bad, 30));
+    put32(bad + 4, 0x10000);
+    TEST_CHECK(!st7735_qoi_init(&qoi, bad, 30));
+    put32(bad + 4, 0xffff);
+    put32(bad + 8, 0xffffffff);
+    TEST_CHECK(!st7735_qoi_init(&qoi, bad, 30));
+    free_image(&img);
+}
+
+/* Whole images, decoded in one go */
+static void test_round_trip(void)
+{
+    const uint32_t sizes[][2] = { { 1, 1 }, { 80, 160 }, { 160, 80 }, { 63, 5 }, { 200, 300 } };
+    for (int kind = 0; kind < IMAGE_KINDS; ++kind) {
+        for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            image_t img;
+            make_image(&img, kind, sizes[s][0], sizes[s][1]);
+            uint32_t count = img.width * img.height;
+            uint16_t *out = malloc(count * sizeof(uint16_t));
+            st7735_qoi_t qoi;
+            TEST_CHECK(st7735_qoi_init(&qoi, img.qoi, img.qoi_size));
+            st7735_qoi_decode(&qoi, out, count);
+            int wrong = check_pixels(&img, out, 0, count);
+            if (wrong) {
+                fprintf(stderr, "%s %ux%u: %d wrong pixels\n", s_kind_names[kind],
+                        img.width, img.height, wrong);
+            }
+            TEST_CHECK_EQ(0, wrong);
+            TEST_CHECK_EQ(count, qoi.pos);
+            TEST_CHECK(qoi.data == qoi.end);
+            free(out);
+            free_image(&img);
+        }
+    }
+}
+
+/* Decoded in random pieces, some of them skipped, as when drawing clipped */
+static void test_pieces(void)
+{
+    for (int kind = 0; kind < IMAGE_KINDS; ++kind) {
+        image_t img;
+        make_image(&img, kind, 100, 90);
+        uint32_t count = img.width * img.height;
+        uint16_t out[200];
+        st7735_qoi_t qoi;
+        TEST_CHECK(st7735_qoi_init(&qoi, img.qoi, img.qoi_size));
+        int wrong = 0;
+        for (uint32_t pos = 0; pos < count;) {
+            uint32_t n = 1 + random8() % 150;
+            n = (n > count - pos) ? count - pos : n;
+            if (random8() % 3 == 0) {
+                st7735_qoi_decode(&qoi, NULL, n);
+            } else {
+                st7735_qoi_decode(&qoi, out, n);
+                wrong += check_pixels(&img, out, pos, n);
+            }
+            pos += n;
+            TEST_CHECK_EQ(pos, qoi.pos);
+        }
+        TEST_CHECK_EQ(0, wrong);
+        free_image(&img);
+    }
+}
+
+/* Cut at every length: the chunks which are all there are decoded, and the
+ * last of their pixels is repeated in place of the rest
+ */
+static void test_truncated(void)
+{
+    for (int kind = 0; kind < IMAGE_KINDS; ++kind) {
+        image_t img;
+        make_image(&img, kind, 20, 15);
+        uint32_t count = img.width * img.height;
+        uint16_t out[20 * 15];
+        int wrong = 0;
+        int chunk = -1;
+        for (size_t size = 22; size < img.qoi_size; ++size) {
+            // exactly sized, so that the sanitizers catch reads past the end
+            uint8_t *data = malloc(size);
+            memcpy(data, img.qoi, size);
+            st7735_qoi_t qoi;
+            TEST_CHECK(st7735_qoi_init(&qoi, data, size));
+            st7735_qoi_decode(&qoi, out, count);
+            // the last 8 bytes are taken as the end marker
+            while (chunk + 1 < img.chunks && img.chunk_end[chunk + 1] <= size - 8) {
+                chunk++;
+            }
+            uint32_t complete = (chunk >= 0) ? img.chunk_pixels[chunk] : 0;
+            wrong += check_pixels(&img, out, 0, complete);
+            uint16_t last = (complete > 0) ? out[complete - 1] : to_565((uint8_t[]) { 0, 0, 0, 255 });
+            for (uint32_t i = complete; i < count; ++i) {
+                // a run which is cut off starts, but doesn't finish
+                if (out[i] != last && i != complete) {
+                    wrong++;
+                    break;
+                }
+                last = out[i];
+            }
+            free(data);
+        }
+        TEST_CHECK_EQ(0, wrong);
+        free_image(&img);
+    }
+}
+
+/* Random damage must not make the decoder read outside of the data */
+static void test_corrupt(void)
+{
+    image_t img;
+    make_image(&img, IMAGE_FEW_COLORS, 40, 30);
+    uint32_t count = img.width * img.height;
+    uint16_t *out = malloc(count * sizeof(uint16_t));
+    uint8_t *data = malloc(img.qoi_size);
+    for (int round = 0; round < 1000; ++round) {
+        memcpy(data, img.qoi, img.qoi_size);
+        int flips = 1 + random8() % 8;
+        for (int i = 0; i < flips; ++i) {
+            data[14 + (random8() | (random8() << 8)) % (img.qoi_size - 14)] = random8();
+        }
+        st7735_qoi_t qoi;
+        TEST_CHECK(st7735_qoi_init(&qoi, data, img.qoi_size));
+        st7735_qoi_decode(&qoi, out, count);
+        TEST_CHECK_EQ(count, qoi.pos);
+    }
+    free(data);
+    free(out);
+    free_image(&img);
+}
+
+/* Drawn on the LCD, partly outside of the screen */
+static void test_draw(void)
+{
+    image_t img;
+    make_image(&img, IMAGE_GRADIENT, 60, 50);
+    const int positions[][2] = { { 0, 0 }, { 10, 20 }, { -7, -9 }, { 130, 50 }, { -59, -49 } };
+    for (int p = 0; p < sizeof(positions) / sizeof(positions[0]); ++p) {
+        int x0 = positions[p][0];
+        int y0 = positions[p][1];
+        st7735_clear_screen(0);
+        TEST_CHECK(st7735_draw_qoi(x0, y0, img.qoi, img.qoi_size));
+        st7735_update_screen();
+        display_flush();
+        int wrong = 0;
+        for (int y = 0; y < emu_lcd_height(); ++y) {
+            for (int x = 0; x < emu_lcd_width(); ++x) {
+                int ix = x - x0;
+                int iy = y - y0;
+                uint16_t expected = 0;
+                if (ix >= 0 && iy >= 0 && ix < img.width && iy < img.height) {
+                    expected = to_565(&img.rgba[(iy * img.width + ix) * 4]);
+                }
+                // the LCD shows the colors as sent, in the other byte order
+                if (emu_lcd_pixel(x, y) != (uint16_t) ((expected >> 8) | (expected << 8))) {
+                    wrong++;
+                }
+            }
+        }
+        TEST_CHECK_EQ(0, wrong);
+    }
+    TEST_CHECK(!st7735_draw_qoi(0, 0, img.qoi, 21));
+    emu_lcd_stats_t stats;
+    emu_lcd_get_stats(&stats);
+    TEST_CHECK_EQ(0, stats.errors);
+    TEST_CHECK_EQ(0, stats.hidden_pixels);
+    free_image(&img);
+}
+
+/* Not a check, decoding speed on this machine to compare changes with */
+static void test_throughput(void)
+{
+    for (int kind = 0; kind < IMAGE_KINDS; ++kind) {
+        image_t img;
+        make_image(&img, kind, 80, 160);
+        uint16_t out[80];
+        const int repeat = 50;
+        clock_t start = clock();
+        for (int r = 0; r < repeat; ++r) {
+            st7735_qoi_t qoi;
+            st7735_qoi_init(&qoi, img.qoi, img.qoi_size);
+            for (uint32_t y = 0; y < img.height; ++y) {
+                st7735_qoi_decode(&qoi, out, img.width);
+            }
+        }
+        double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+        printf("  %-10s %5zu bytes, %.1f Mpixel/s\n", s_kind_names[kind], img.qoi_size,
+               seconds > 0 ? repeat * img.width * img.height / seconds / 1e6 : 0);
+        free_image(&img);
+    }
+}
+
+int main(void)
+{
+    emu_lcd_reset();
+    display_init();
+    display_wait_ready();
+    TEST_RUN(test_header);
+    TEST_RUN(test_round_trip);
+    TEST_RUN(test_pieces);
+    TEST_RUN(test_truncated);
+    TEST_RUN(test_corrupt);
+    TEST_RUN(test_draw);
+    TEST_RUN(test_throughput);
+    return TEST_RESULT();
+}
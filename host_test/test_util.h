@@ -0,0 +1,39 @@
+/**
+ *  Minimal checks for the host tests.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+static int s_test_failures;
+
+// Report a failed check and continue
+#define TEST_CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            s_test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_CHECK_EQ(expected, actual) do { \
+        long long e_ = (long long) (expected); \
+        long long a_ = (long long) (actual); \
+        if (e_ != a_) { \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+                    __FILE__, __LINE__, #expected, #actual, e_, a_); \
+            s_test_failures++; \
+        } \
+    } while (0)
+
+// Run a test function, printing its name
+#define TEST_RUN(func) do { \
+        printf("%s\n", #func); \
+        func(); \
+    } while (0)
+
+// Exit code of the test program
+#define TEST_RESULT() (s_test_failures == 0 ? 0 : 1)
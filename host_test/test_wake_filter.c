@@ -0,0 +1,91 @@
+/**
+ *  Tests of the touch filter of the deep sleep wake stub, against pin traces.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "wake_filter.h"
+#include "test_util.h"
+
+// as used by the wake stub (main/board_wake_stub.c) with BOARD_CONFIG_DEFAULT
+#define SAMPLE_US   1000
+#define HOLD_US     40000
+#define DEBOUNCE_US 5000
+
+/** @struct Level of the touchpad INT pin over time, starting high at 0
+ * (the touch which woke up the chip), then toggling at each of the times.
+ */
+typedef struct {
+    const char *name;
+    bool held;              // expected result of the filter
+    int edge_count;
+    uint32_t edges_us[8];
+} pin_trace_t;
+
+static const pin_trace_t s_traces[] = {
+    { "held", true, 0, {} },
+    { "released after the hold time", true, 1, { 41000 } },
+    { "tap", false, 1, { 12000 } },
+    { "brushed", false, 1, { 900 } },
+    { "bounce while held", true, 2, { 15000, 17000 } },
+    { "bounces shorter than the debounce time", true, 6, { 3000, 7000, 9000, 13000, 30000, 33500 } },
+    { "bounce at the release of a tap", false, 3, { 25000, 26500, 27500 } },
+    { "low as long as the debounce time", false, 2, { 20000, 25000 } },
+    { "released at the end of the hold time", true, 1, { 39500 } },
+};
+
+static const pin_trace_t *s_trace;
+// time since the wakeup
+static uint32_t s_now_us;
+
+static int read_level(void)
+{
+    int level = 1;
+    for (int i = 0; i < s_trace->edge_count && s_trace->edges_us[i] <= s_now_us; ++i) {
+        level = !level;
+    }
+    return level;
+}
+
+static void delay(uint32_t us)
+{
+    s_now_us += us;
+}
+
+static void test_traces(void)
+{
+    for (size_t i = 0; i < sizeof(s_traces) / sizeof(s_traces[0]); ++i) {
+        s_trace = &s_traces[i];
+        s_now_us = 0;
+        bool held = wake_filter_touch_held(&read_level, &delay, HOLD_US, DEBOUNCE_US, SAMPLE_US);
+        if (held != s_trace->held) {
+            fprintf(stderr, "trace \"%s\": %s, expected %s\n", s_trace->name,
+                    held ? "held" : "rejected", s_trace->held ? "held" : "rejected");
+        }
+        TEST_CHECK(held == s_trace->held);
+        // doesn't take longer than the hold time either way
+        TEST_CHECK(s_now_us <= HOLD_US);
+    }
+}
+
+/* A rejected touch is rejected as soon as the release is longer than the
+ * debounce time, without waiting for the rest of the hold time.
+ */
+static void test_early_reject(void)
+{
+    const pin_trace_t tap = { "tap", false, 1, { 12000 } };
+    s_trace = &tap;
+    s_now_us = 0;
+    TEST_CHECK(!wake_filter_touch_held(&read_level, &delay, HOLD_US, DEBOUNCE_US, SAMPLE_US));
+    TEST_CHECK(s_now_us < tap.edges_us[0] + DEBOUNCE_US);
+}
+
+int main(void)
+{
+    TEST_RUN(test_traces);
+    TEST_RUN(test_early_reject);
+    return TEST_RESULT();
+}
@@ -0,0 +1,152 @@
+/**
+ *  T-Wristband always-on clock.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#include "board.h"
+#include "pcf8563.h"
+#include "display_task.h"
+#include "time_service.h"
+#include "ambient_clock.h"
+
+#if CONFIG_APP_ALWAYS_ON_CLOCK
+
+/* Print the power statistics after this many updates */
+#define AMBIENT_STATS_UPDATES   10
+
+#define EVENT_HANDLER(name_) void name_(void* arg, esp_event_base_t base, int id, void* data)
+
+static EVENT_HANDLER(on_rtc_interrupt);
+static EVENT_HANDLER(on_frame_done);
+
+static bool s_active;
+/* time of the RTC interrupt whose frame is being drawn, 0 if none */
+static int64_t s_wakeup_us;
+/* awake time statistics since s_stats_start_us */
+static int64_t s_stats_start_us;
+static int s_updates;
+static int64_t s_awake_us;
+static int64_t s_awake_max_us;
+
+static const char *TAG = "ambient";
+
+void ambient_clock_init(void)
+{
+    ESP_ERROR_CHECK(esp_event_handler_register(BOARD_EVENT, RTC_INTERRUPT, &on_rtc_interrupt, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(DISPLAY_EVENT, DISPLAY_FRAME_DONE, &on_frame_done, NULL));
+}
+
+/* Alarm at the start of the next minute, which also releases RTC INT */
+static void ambient_clock_arm(void)
+{
+    time_service_reload();
+    struct tm tm;
+    time_service_get(&tm);
+    pcf8563_alarm_t alarm = {
+        .minute = (tm.tm_min + 1) % 60,
+        .hour = -1,
+        .day = -1,
+        .weekday = -1
+    };
+    pcf8563_set_alarm(&alarm);
+    board_rtc_interrupt_enable(true);
+}
+
+void ambient_clock_enter(void)
+{
+    if (s_active) {
+        return;
+    }
+    s_active = true;
+    s_wakeup_us = 0;
+    s_stats_start_us = esp_timer_get_time();
+    s_updates = 0;
+    s_awake_us = 0;
+    s_awake_max_us = 0;
+    board_lcd_brightness(CONFIG_APP_AMBIENT_BRIGHTNESS);
+    display_task_ambient(true);
+    ambient_clock_arm();
+    ESP_LOGD(TAG, "enter");
+}
+
+void ambient_clock_exit(void)
+{
+    if (!s_active) {
+        return;
+    }
+    s_active = false;
+    board_rtc_interrupt_enable(false);
+    pcf8563_disable_alarm();
+    display_task_ambient(false);
+    /* the system clock has been running on RTC_SLOW_CLK */
+    time_service_reload();
+    ESP_LOGD(TAG, "exit");
+}
+
+#if CONFIG_APP_AMBIENT_STATS
+/* Only what is measured here is printed; the current in each state has to
+ * be measured on the board to turn these times into energy.
+ */
+static void ambient_clock_report(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    /* esp_timer keeps counting in light sleep, so this is the elapsed time */
+    int64_t period_us = now_us - s_stats_start_us;
+    int duty_ppm = (int) (s_awake_us * 1000000 / period_us);
+    ESP_LOGI(TAG, "%d updates in %d s: awake %d us per update (max %d us), duty cycle %d ppm",
+             s_updates, (int) (period_us / 1000000), (int) (s_awake_us / s_updates),
+             (int) s_awake_max_us, duty_ppm);
+    /* time spent in light sleep and at each CPU frequency since boot,
+     * including waking up and going back to sleep, which isn't counted above
+     */
+    esp_pm_dump_locks(stdout);
+    s_stats_start_us = now_us;
+    s_updates = 0;
+    s_awake_us = 0;
+    s_awake_max_us = 0;
+}
+#endif
+
+static EVENT_HANDLER(on_rtc_interrupt)
+{
+    if (!s_active) {
+        return;
+    }
+    s_wakeup_us = *(int64_t *) data;
+    ambient_clock_arm();
+    struct tm tm;
+    time_service_get(&tm);
+    display_task_time(&tm);
+}
+
+static EVENT_HANDLER(on_frame_done)
+{
+    if (!s_active || s_wakeup_us == 0) {
+        return;
+    }
+    /* from the interrupt to the frame being sent; the time to wake up from
+     * light sleep and to go back to it isn't included
+     */
+    int64_t awake_us = esp_timer_get_time() - s_wakeup_us;
+    s_awake_us += awake_us;
+    s_awake_max_us = MAX(s_awake_max_us, awake_us);
+    s_wakeup_us = 0;
+    ++s_updates;
+#if CONFIG_APP_AMBIENT_STATS
+    if (s_updates == AMBIENT_STATS_UPDATES) {
+        ambient_clock_report();
+    }
+#endif
+}
+
+#endif // CONFIG_APP_ALWAYS_ON_CLOCK
@@ -0,0 +1,21 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Always-on clock: with the screen off, the LCD stays on in its low power
+ * mode with a dim backlight, and the chip stays in light sleep between
+ * minutes. The RTC alarm wakes it up at the start of each minute to draw
+ * the digits which have changed.
+ */
+
+/* Register the event handlers; call once, before ambient_clock_enter */
+void ambient_clock_init(void);
+/* Start showing the time in low power mode, until ambient_clock_exit */
+void ambient_clock_enter(void);
+/* Stop the minute updates; the caller sets the brightness it needs */
+void ambient_clock_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -10,14 +10,20 @@
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "driver/rtc_io.h"
-#include "driver/i2c.h"
+#include "driver/ledc.h"
+#include "i2c_bus.h"
 #include "board.h"
+#include "board_wake_stub.h"
 #include "pcf8563.h"
 
 static void board_touchpad_intr_handler(void *arg);
+static void board_rtc_intr_handler(void *arg);
+static void board_backlight_init(void);
 void board_lcd_init(void);
 
 static int64_t s_touchpad_press_time;
+static volatile bool s_touchpad_wakeup;
+static bool s_rtc_intr_installed;
 static board_config_t s_config;
 static const i2c_port_t s_i2c_port = I2C_NUM_0;
 
@@ -29,6 +35,10 @@ void board_init(const board_config_t *config)
 {
     s_config = *config;
     ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    uint32_t rejected = board_wake_stub_rejected_count();
+    if (rejected > 0) {
+        ESP_LOGI(TAG, "%u short touches ignored in deep sleep", (unsigned) rejected);
+    }
 }
 
 void board_touchpad_enable(void)
@@ -56,8 +66,17 @@ void board_touchpad_enable(void)
 
 void board_sleep(void)
 {
+    /* keep the LCD out of reset and deselected, so that it keeps its memory */
+    gpio_hold_en(TFT_RST_PIN);
+    gpio_hold_en(TFT_CS_PIN);
+    gpio_hold_en(TFT_DC_PIN);
+    gpio_deep_sleep_hold_en();
+
     esp_deep_sleep_disable_rom_logging();
+    board_wake_stub_configure(s_config.touchpad_wake_hold_ms, s_config.touchpad_wake_debounce_ms);
     esp_sleep_enable_ext1_wakeup(BIT64(TP_INT_PIN), ESP_EXT1_WAKEUP_ANY_HIGH);
+    /* RTC alarm or timer; INT is open drain, active low */
+    esp_sleep_enable_ext0_wakeup(RTC_INT_PIN, 0);
     esp_deep_sleep_start();
 }
 
@@ -65,6 +84,12 @@ static void board_touchpad_intr_handler(void *arg)
 {
     int task_unblocked = 0;
     int level = gpio_get_level(TP_INT_PIN);
+    if (s_touchpad_wakeup) {
+        /* triggered by the level, go back to edges before it triggers again */
+        gpio_wakeup_disable(TP_INT_PIN);
+        gpio_set_intr_type(TP_INT_PIN, GPIO_PIN_INTR_ANYEDGE);
+        s_touchpad_wakeup = false;
+    }
     if (level) {
         ESP_EARLY_LOGI(TAG, "Touchpad press");
         s_touchpad_press_time = esp_timer_get_time();
@@ -83,35 +108,122 @@ static void board_touchpad_intr_handler(void *arg)
 
 void board_lcd_enable(void)
 {
+    /* set the levels first: a low pulse on RST would clear the LCD memory */
+    gpio_set_level(TFT_RST_PIN, 1);
+    gpio_set_level(TFT_CS_PIN, 1);
     gpio_config_t pins_config = {
-        .pin_bit_mask = BIT64(TFT_RST_PIN) | BIT64(TFT_BL_PIN) | BIT64(TFT_DC_PIN),
+        .pin_bit_mask = BIT64(TFT_RST_PIN) | BIT64(TFT_DC_PIN) | BIT64(TFT_CS_PIN),
         .mode = GPIO_MODE_OUTPUT
     };
     ESP_ERROR_CHECK(gpio_config(&pins_config));
-    gpio_set_level(TFT_RST_PIN, 1);
+    /* release the pins held in board_sleep */
+    gpio_hold_dis(TFT_RST_PIN);
+    gpio_hold_dis(TFT_CS_PIN);
+    gpio_hold_dis(TFT_DC_PIN);
+    gpio_deep_sleep_hold_dis();
+    board_backlight_init();
+}
+
+/* Backlight PWM is clocked from the 8 MHz RTC oscillator: its frequency
+ * doesn't change with the APB frequency when power management scales it,
+ * and it keeps running in light sleep.
+ */
+static void board_backlight_init(void)
+{
+    ledc_timer_config_t timer_config = {
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .duty_resolution = LEDC_TIMER_7_BIT,
+        .timer_num = LEDC_TIMER_0,
+        .freq_hz = 5000,
+        .clk_cfg = LEDC_USE_RTC8M_CLK
+    };
+    ESP_ERROR_CHECK(ledc_timer_config(&timer_config));
+    ledc_channel_config_t channel_config = {
+        .gpio_num = TFT_BL_PIN,
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel = LEDC_CHANNEL_0,
+        .timer_sel = LEDC_TIMER_0,
+        .duty = 0
+    };
+    ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
 }
 
 void board_lcd_backlight(bool enable)
 {
-    gpio_set_level(TFT_BL_PIN, enable);
+    board_lcd_brightness(enable ? 100 : 0);
 }
 
-static void board_i2c_init(void)
+void board_lcd_brightness(int percent)
 {
-    ESP_ERROR_CHECK(i2c_driver_install(s_i2c_port, I2C_MODE_MASTER, 0, 0, 0));
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_SDA_PIN,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_io_num = I2C_SCL_PIN,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = 100000
-    };
-    ESP_ERROR_CHECK(i2c_param_config(s_i2c_port, &conf));
+    uint32_t duty = percent * ((1 << LEDC_TIMER_7_BIT) - 1) / 100;
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty);
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    /* the oscillator is powered down in light sleep unless it is needed */
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, percent > 0 ? ESP_PD_OPTION_ON : ESP_PD_OPTION_AUTO);
+}
+
+void board_touchpad_light_sleep_wakeup(bool enable)
+{
+    /* light sleep only wakes up on a level, which replaces the edge interrupt
+     * until the interrupt handler restores it
+     */
+    if (enable) {
+        s_touchpad_wakeup = true;
+        ESP_ERROR_CHECK(gpio_wakeup_enable(TP_INT_PIN, GPIO_INTR_HIGH_LEVEL));
+        ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+    } else if (s_touchpad_wakeup) {
+        gpio_wakeup_disable(TP_INT_PIN);
+        gpio_set_intr_type(TP_INT_PIN, GPIO_PIN_INTR_ANYEDGE);
+        s_touchpad_wakeup = false;
+    }
 }
 
 void board_rtc_init(void)
 {
-    board_i2c_init();
+    /* RTC and IMU both support fast mode */
+    ESP_ERROR_CHECK(i2c_bus_init(s_i2c_port, I2C_SDA_PIN, I2C_SCL_PIN, 400000));
     pcf8563_init(s_i2c_port);
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0) {
+        /* release INT, otherwise the next deep sleep ends right away */
+        uint8_t flags = pcf8563_clear_flags();
+        ESP_LOGI(TAG, "RTC wakeup, flags 0x%02x", flags);
+    }
+}
+
+void board_rtc_interrupt_enable(bool enable)
+{
+    if (!s_rtc_intr_installed) {
+        gpio_config_t int_pin_config = {
+            .pin_bit_mask = BIT64(RTC_INT_PIN),
+            .mode = GPIO_MODE_INPUT,
+            .intr_type = GPIO_PIN_INTR_DISABLE
+        };
+        ESP_ERROR_CHECK(gpio_config(&int_pin_config));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(RTC_INT_PIN, board_rtc_intr_handler, NULL));
+        s_rtc_intr_installed = true;
+    }
+    /* INT stays low until the flags are cleared, so this is a level
+     * interrupt, which also wakes up from light sleep
+     */
+    if (enable) {
+        ESP_ERROR_CHECK(gpio_wakeup_enable(RTC_INT_PIN, GPIO_INTR_LOW_LEVEL));
+        ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+        gpio_intr_enable(RTC_INT_PIN);
+    } else {
+        gpio_intr_disable(RTC_INT_PIN);
+        gpio_wakeup_disable(RTC_INT_PIN);
+    }
+}
+
+static void board_rtc_intr_handler(void *arg)
+{
+    int task_unblocked = 0;
+    /* disabled until the flags are cleared and it is enabled again */
+    gpio_intr_disable(RTC_INT_PIN);
+    gpio_wakeup_disable(RTC_INT_PIN);
+    int64_t time_us = esp_timer_get_time();
+    ESP_ERROR_CHECK(esp_event_isr_post(BOARD_EVENT, RTC_INTERRUPT, &time_us, sizeof(time_us), &task_unblocked));
+    if (task_unblocked) {
+        portYIELD_FROM_ISR();
+    }
 }
@@ -7,11 +7,13 @@ extern "C" {
 #endif
 
 #define TP_INT_PIN          33
+#define TP_INT_RTCIO        8   /* RTC IO number of TP_INT_PIN */
 #define TP_PWR_PIN          25
 #define I2C_SDA_PIN         21
 #define I2C_SCL_PIN         22
 #define IMU_INT_PIN         38
 #define RTC_INT_PIN         34
+#define RTC_INT_RTCIO       4   /* RTC IO number of RTC_INT_PIN */
 #define BATT_ADC_PIN        35
 #define VBUS_PIN            36
 #define LED_PIN             4
@@ -27,17 +29,28 @@ extern "C" {
 
 typedef struct {
     int touchpad_long_press_threshold_ms;
+    int touchpad_wake_hold_ms;      /* shorter touches don't wake up from deep sleep */
+    int touchpad_wake_debounce_ms;  /* releases shorter than this are ignored */
 } board_config_t;
 
 #define BOARD_CONFIG_DEFAULT() (board_config_t) { \
     .touchpad_long_press_threshold_ms = 1500, \
+    .touchpad_wake_hold_ms = 40, \
+    .touchpad_wake_debounce_ms = 5, \
 };
 
 void board_init(const board_config_t *config);
 void board_touchpad_enable(void);
 void board_lcd_enable(void);
 void board_lcd_backlight(bool enable);
+void board_lcd_brightness(int percent);
+/* Wake up from light sleep when the touchpad is touched */
+void board_touchpad_light_sleep_wakeup(bool enable);
 void board_rtc_init(void);
+/* Post RTC_INTERRUPT when RTC INT goes low, also waking up from light sleep.
+ * Fires once: enable again after clearing the RTC flags.
+ */
+void board_rtc_interrupt_enable(bool enable);
 void board_sleep(void);
 
 ESP_EVENT_DECLARE_BASE(BOARD_EVENT);
@@ -45,7 +58,8 @@ ESP_EVENT_DECLARE_BASE(BOARD_EVENT);
 /* board event IDs */
 enum {
     TOUCHPAD_PRESS,
-    TOUCHPAD_LONG_PRESS
+    TOUCHPAD_LONG_PRESS,
+    RTC_INTERRUPT,          /* data: int64_t, esp_timer time of the interrupt */
 };
 
 
@@ -0,0 +1,80 @@
+/**
+ *  T-Wristband deep sleep wake stub, filtering out spurious touchpad wakeups.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdbool.h>
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/rtc_io_reg.h"
+#include "esp32/rom/ets_sys.h"
+#include "esp32/rom/rtc.h"
+#include "board.h"
+#include "board_wake_stub.h"
+#include "wake_filter.h"
+
+/* Interval at which the touchpad line is sampled */
+#define WAKE_STUB_SAMPLE_US 1000
+
+/* Everything used by the wake stub has to be in RTC memory */
+static RTC_DATA_ATTR uint32_t s_hold_us;
+static RTC_DATA_ATTR uint32_t s_debounce_us;
+static RTC_DATA_ATTR uint32_t s_rejected_count;
+
+void board_wake_stub_configure(int hold_ms, int debounce_ms)
+{
+    s_hold_us = hold_ms * 1000;
+    s_debounce_us = debounce_ms * 1000;
+}
+
+uint32_t board_wake_stub_rejected_count(void)
+{
+    return s_rejected_count;
+}
+
+static int RTC_IRAM_ATTR wake_stub_read_touchpad(void)
+{
+    uint32_t in = REG_GET_FIELD(RTC_GPIO_IN_REG, RTC_GPIO_IN_NEXT);
+    return (in >> TP_INT_RTCIO) & 1;
+}
+
+static bool RTC_IRAM_ATTR wake_stub_rtc_int_active(void)
+{
+    uint32_t in = REG_GET_FIELD(RTC_GPIO_IN_REG, RTC_GPIO_IN_NEXT);
+    return ((in >> RTC_INT_RTCIO) & 1) == 0;
+}
+
+static void RTC_IRAM_ATTR wake_stub_delay(uint32_t us)
+{
+    ets_delay_us(us);
+}
+
+void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+    esp_default_wake_deep_sleep();
+
+    /* RTC alarms and timers always wake up the application */
+    if (s_hold_us == 0 || wake_stub_rtc_int_active() ||
+            wake_filter_touch_held(&wake_stub_read_touchpad, &wake_stub_delay,
+                                   s_hold_us, s_debounce_us, WAKE_STUB_SAMPLE_US)) {
+        /* continue booting the application */
+        return;
+    }
+
+    ++s_rejected_count;
+    /* wakeup is on high level, wait for the touchpad to be released */
+    while (wake_stub_read_touchpad()) {
+        ets_delay_us(WAKE_STUB_SAMPLE_US);
+    }
+    /* clear the wakeup reason and go back to sleep, with the same stub */
+    REG_SET_BIT(RTC_CNTL_EXT_WAKEUP1_REG, RTC_CNTL_EXT_WAKEUP1_STATUS_CLR);
+    REG_WRITE(RTC_ENTRY_ADDR_REG, (uint32_t) &esp_wake_deep_sleep);
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    SET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    while (true) {
+        ;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Set how long the touchpad has to be held to wake up from deep sleep.
+ * Shorter touches are rejected in the wake stub, which goes back to sleep
+ * without booting the application. 'hold_ms' = 0 accepts all wakeups.
+ */
+void board_wake_stub_configure(int hold_ms, int debounce_ms);
+
+/* Number of wakeups rejected since power on */
+uint32_t board_wake_stub_rejected_count(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,71 @@
+/**
+ *  T-Wristband boot time profiling.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+#include "boot_profile.h"
+
+#define BOOT_PROFILE_MAX_MARKS 16
+
+typedef struct {
+    const char *name;
+    int64_t time_us;
+} boot_profile_mark_t;
+
+static boot_profile_mark_t s_marks[BOOT_PROFILE_MAX_MARKS];
+static int s_mark_count;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "profile";
+
+void boot_profile_mark(const char *name)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (s_mark_count < BOOT_PROFILE_MAX_MARKS) {
+        s_marks[s_mark_count++] = (boot_profile_mark_t) {
+            .name = name,
+            .time_us = now
+        };
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int64_t boot_profile_get(const char *name)
+{
+    for (int i = 0; i < s_mark_count; ++i) {
+        if (strcmp(s_marks[i].name, name) == 0) {
+            return s_marks[i].time_us;
+        }
+    }
+    return -1;
+}
+
+void boot_profile_report(void)
+{
+    /* esp_timer starts counting early in the app startup,
+     * so the time spent in the ROM and the bootloader is not included.
+     */
+    bool touch_wake = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT1;
+    ESP_LOGI(TAG, "%s boot, times since startup:", touch_wake ? "touch" : "cold");
+    ESP_LOGI(TAG, "%-16s %8s %8s", "stage", "end, us", "took, us");
+    int64_t prev = 0;
+    for (int i = 0; i < s_mark_count; ++i) {
+        const boot_profile_mark_t *mark = &s_marks[i];
+        ESP_LOGI(TAG, "%-16s %8d %8d", mark->name,
+                 (int) mark->time_us, (int) (mark->time_us - prev));
+        prev = mark->time_us;
+    }
+    int64_t first_pixel = boot_profile_get("first_pixel");
+    if (first_pixel >= 0) {
+        ESP_LOGI(TAG, "%s-to-first-pixel: %d us",
+                 touch_wake ? "touch" : "boot", (int) first_pixel);
+    }
+}
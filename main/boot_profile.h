@@ -0,0 +1,21 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Record the time at which a boot stage has finished.
+ * 'name' must be a string literal (only the pointer is stored).
+ */
+void boot_profile_mark(const char *name);
+
+/* Time of the given mark, in microseconds since startup, or -1 if not recorded */
+int64_t boot_profile_get(const char *name);
+
+/* Print all recorded stages, with the time each one took */
+void boot_profile_report(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,63 +6,327 @@
  */
 
 #include <string.h>
+#include <stdbool.h>
 #include <time.h>
+#include <sys/param.h>
+#include "esp_attr.h"
+#include "esp_sleep.h"
 #include "display.h"
 #include "board.h"
 #include "st7735.h"
+#include "assets.h"
 
 
+#define TIME_FG_COLOR   0x007b
+#define TIME_BG_COLOR   0xffff
+#define TIME_FONT       X3
+// longest text of a field, with the terminating zero
+#define TIME_FIELD_LEN  8
+
+// Dial of the analog time screen, in pixels; same in both orientations
+#define DIAL_X          40
+#define DIAL_Y          40
+#define DIAL_R          35
+#define DIAL_COLOR      0x04af
+
+typedef struct {
+    uint8_t x;
+    uint8_t y;
+    const char *format;     // strftime format
+    const char *font;       // asset font used instead of TIME_FONT, if present
+} time_field_t;
+
+/** @enum Fields of the time screen */
+enum {
+    TIME_FIELD_WEEKDAY,
+    TIME_FIELD_DAY,
+    TIME_FIELD_MONTH,
+    TIME_FIELD_HH_MM,
+    TIME_FIELD_COUNT
+};
+
+#if !CONFIG_APP_TIME_FACE_ANALOG
+static const time_field_t s_time_fields[TIME_FIELD_COUNT] = {
+    [TIME_FIELD_WEEKDAY] = { 10, 8, "%a" },
+    [TIME_FIELD_DAY] = { 18, 32, "%d" },
+    [TIME_FIELD_MONTH] = { 10, 56, "%b" },
+    [TIME_FIELD_HH_MM] = { 75, 32, "%H:%M", "time" },
+};
+
+/* Same fields, stacked, for the portrait orientation */
+static const time_field_t s_time_fields_portrait[TIME_FIELD_COUNT] = {
+    [TIME_FIELD_WEEKDAY] = { 24, 16, "%a" },
+    [TIME_FIELD_DAY] = { 29, 44, "%d" },
+    [TIME_FIELD_MONTH] = { 24, 72, "%b" },
+    [TIME_FIELD_HH_MM] = { 13, 120, "%H:%M", "time" },
+};
+#else
+/* Date next to the dial of the analog time screen */
+static const time_field_t s_time_fields[TIME_FIELD_COUNT] = {
+    [TIME_FIELD_WEEKDAY] = { 100, 14, "%a" },
+    [TIME_FIELD_DAY] = { 105, 32, "%d" },
+    [TIME_FIELD_MONTH] = { 100, 50, "%b" },
+    [TIME_FIELD_HH_MM] = { 0, 0, "" },    // shown by the hands
+};
+
+/* Same fields, below the dial, for the portrait orientation */
+static const time_field_t s_time_fields_portrait[TIME_FIELD_COUNT] = {
+    [TIME_FIELD_WEEKDAY] = { 24, 88, "%a" },
+    [TIME_FIELD_DAY] = { 29, 108, "%d" },
+    [TIME_FIELD_MONTH] = { 24, 128, "%b" },
+    [TIME_FIELD_HH_MM] = { 0, 0, "" },
+};
+#endif
+
+/* What is currently shown on the time screen. Kept in RTC memory,
+ * since the LCD keeps showing it while the chip is in deep sleep.
+ */
+static RTC_DATA_ATTR struct {
+    bool valid;     // false if the time screen is not shown
+    char text[TIME_FIELD_COUNT][TIME_FIELD_LEN];
+    int minutes;    // time shown by the hands, minutes since midnight
+} s_time_face;
+
+/* Set if the LCD was put to sleep with its memory intact */
+static RTC_DATA_ATTR bool s_lcd_retained;
+
+static const time_field_t *time_fields(void);
+static void draw_field_diff(const time_field_t *field, const char *prev, const char *text);
+static void draw_text_font(const asset_font_t *font, int x, int y, const char *str);
+static void restore_time_face(void);
+#if CONFIG_ST7735_FRAMEBUFFER
+static void draw_dial(int minutes);
+#endif
+
 void display_init(void)
 {
-    st7735_init();
+    st7735_set_rotation(CONFIG_APP_DISPLAY_ROTATION);
+    if (s_lcd_retained && esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_UNDEFINED) {
+        // woken up from deep sleep, the LCD still shows the last screen
+        st7735_init_start(true);
+        restore_time_face();
+    } else {
+        st7735_init_start(false);
+        s_time_face.valid = false;
+    }
+    s_lcd_retained = false;
+}
+
+void display_wait_ready(void)
+{
+    st7735_init_wait();
+}
+
+void display_sleep(void)
+{
+    st7735_sleep();
+    s_lcd_retained = true;
+}
+
+void display_set_ambient(bool enable)
+{
+    st7735_set_idle_mode(enable);
 }
 
 static void draw_box(void)
 {
-    st7735_draw_line_h(0, MAX_X - 1, MIN_Y, 0x04af);
-    st7735_draw_line_h(0, MAX_X - 1, MAX_Y - 1, 0x04af);
-    st7735_draw_line_v(1, MIN_Y, MAX_Y - 1, 0x04af);
-    st7735_draw_line_v(MAX_X - 1, MIN_Y, MAX_Y - 1, 0x04af);
+    st7735_draw_rect(0, st7735_width() - 1, 0, st7735_height() - 1, 0x04af);
+}
+
+void display_flush(void)
+{
+    st7735_flush();
+}
+
+void display_invalidate(void)
+{
+    s_time_face.valid = false;
 }
 
 void display_hello(void)
 {
+    display_invalidate();
     st7735_clear_screen(0xffff);
 
-    draw_box();
+    asset_image_t image;
+    if (assets_get_image("hello", &image) == ESP_OK) {
+        // centered, drawn straight from the asset partition
+        int x = (st7735_width() - image.width) / 2;
+        int y = (st7735_height() - image.height) / 2;
+        if (image.pixels) {
+            st7735_draw_image(x, y, image.width, image.height, image.pixels);
+        } else {
+            st7735_draw_qoi(x, y, image.qoi, image.qoi_size);
+        }
+    } else {
+        draw_box();
 
-    st7735_set_position(10, MIN_Y + 10);
-    st7735_draw_str("Hello", 0x007b, X3);
-    st7735_set_position(10, MIN_Y + 45);
-    st7735_draw_str("T-Wristband", 0x007b, X3);
+        st7735_set_position(10, 10);
+        st7735_draw_str_bg("Hello", 0x007b, 0xffff, X3);
+        st7735_set_position(10, 45);
+        st7735_draw_str_bg("T-Wristband", 0x007b, 0xffff, X3);
+    }
 
     st7735_update_screen();
 }
 
 void display_time(const struct tm *tm)
 {
-    st7735_clear_screen(0xffff);
+    display_render_time(tm);
+    display_update();
+}
+
+void display_render_time(const struct tm *tm)
+{
+    if (!s_time_face.valid) {
+        st7735_clear_screen(TIME_BG_COLOR);
+        draw_box();
+        memset(s_time_face.text, 0, sizeof(s_time_face.text));
+        s_time_face.minutes = -1;
+        s_time_face.valid = true;
+    }
+
+#if CONFIG_APP_TIME_FACE_ANALOG
+    int minutes = tm->tm_hour * 60 + tm->tm_min;
+    if (minutes != s_time_face.minutes) {
+        draw_dial(minutes);
+        s_time_face.minutes = minutes;
+    }
+#endif
+
+    for (int i = 0; i < TIME_FIELD_COUNT; ++i) {
+        const time_field_t *field = &time_fields()[i];
+        char buf[TIME_FIELD_LEN] = {};
+        strftime(buf, sizeof(buf), field->format, tm);
+        draw_field_diff(field, s_time_face.text[i], buf);
+        memcpy(s_time_face.text[i], buf, sizeof(buf));
+    }
+}
+
+void display_update(void)
+{
+    st7735_update_screen();
+}
+
+/* Framebuffer is lost in deep sleep; render what the LCD shows into it,
+ * so that later partial updates match.
+ */
+static void restore_time_face(void)
+{
+#if CONFIG_ST7735_FRAMEBUFFER
+    if (!s_time_face.valid) {
+        return;
+    }
+    st7735_fb_restore_begin();
+    st7735_clear_screen(TIME_BG_COLOR);
     draw_box();
+    for (int i = 0; i < TIME_FIELD_COUNT; ++i) {
+        draw_field_diff(&time_fields()[i], "", s_time_face.text[i]);
+    }
+#if CONFIG_APP_TIME_FACE_ANALOG
+    draw_dial(s_time_face.minutes);
+#endif
+    st7735_fb_restore_end();
+#endif
+}
 
-    char buf[64] = {};
-    strftime(buf, sizeof(buf), "%a", tm);
-    st7735_set_position(10, MIN_Y + 8);
-    st7735_draw_str(buf, 0x007b, X3);
+/* Layout of the time screen for the current orientation */
+static const time_field_t *time_fields(void)
+{
+    if (st7735_width() < st7735_height()) {
+        return s_time_fields_portrait;
+    }
+    return s_time_fields;
+}
 
-    memset(buf, 0, sizeof(buf));
-    strftime(buf, sizeof(buf), "%d", tm);
-    st7735_set_position(18, MIN_Y + 32);
-    st7735_draw_str(buf, 0x007b, X3);
+#if CONFIG_ST7735_FRAMEBUFFER
+void display_render_dial(const struct tm *tm)
+{
+    draw_dial(tm->tm_hour * 60 + tm->tm_min);
+}
 
-    memset(buf, 0, sizeof(buf));
-    strftime(buf, sizeof(buf), "%b", tm);
-    st7735_set_position(10, MIN_Y + 56);
-    st7735_draw_str(buf, 0x007b, X3);
+/* Draw the dial and the hands, anti-aliased, over its whole area */
+static void draw_dial(int minutes)
+{
+    const int one = ST7735_AA_ONE;
+    const int cx = DIAL_X * one;
+    const int cy = DIAL_Y * one;
 
-    memset(buf, 0, sizeof(buf));
-    strftime(buf, sizeof(buf), "%H:%M", tm);
-    st7735_set_position(75, MIN_Y + 32);
-    st7735_draw_str(buf, 0x007b, X3);
+    st7735_fill_rect(DIAL_X - DIAL_R - 1, DIAL_X + DIAL_R + 1,
+                     DIAL_Y - DIAL_R - 1, DIAL_Y + DIAL_R + 1, TIME_BG_COLOR);
+    st7735_aa_circle(cx, cy, DIAL_R * one, one * 3 / 2, DIAL_COLOR);
+    for (int hour = 0; hour < 12; ++hour) {
+        // longer and thicker marks at 12, 3, 6 and 9
+        bool quarter = (hour % 3) == 0;
+        int angle = hour * ST7735_AA_TURN / 12;
+        int x0, y0, x1, y1;
+        st7735_aa_polar(cx, cy, (DIAL_R - (quarter ? 8 : 6)) * one, angle, &x0, &y0);
+        st7735_aa_polar(cx, cy, (DIAL_R - 3) * one, angle, &x1, &y1);
+        st7735_aa_line(x0, y0, x1, y1, quarter ? 2 * one : one, TIME_FG_COLOR);
+    }
 
-    st7735_update_screen();
+    // hour hand turns once in 12 hours, the minute hand once an hour
+    int hour_angle = (minutes % 720) * ST7735_AA_TURN / 720;
+    int minute_angle = (minutes % 60) * ST7735_AA_TURN / 60;
+    int x, y;
+    st7735_aa_polar(cx, cy, (DIAL_R / 2) * one, hour_angle, &x, &y);
+    st7735_aa_line(cx, cy, x, y, 3 * one, TIME_FG_COLOR);
+    st7735_aa_polar(cx, cy, (DIAL_R - 8) * one, minute_angle, &x, &y);
+    st7735_aa_line(cx, cy, x, y, 2 * one, TIME_FG_COLOR);
+    st7735_aa_fill_circle(cx, cy, 5 * one / 2, DIAL_COLOR);
+}
+#endif // CONFIG_ST7735_FRAMEBUFFER
+
+/* Redraw the characters of a text field which differ from the previous
+ * contents, as runs of adjacent changed characters.
+ */
+static void draw_field_diff(const time_field_t *field, const char *prev, const char *text)
+{
+    asset_font_t font;
+    bool asset_font = field->font && assets_get_font(field->font, &font) == ESP_OK;
+    int advance = asset_font ? font.width : st7735_char_advance(TIME_FONT);
+    size_t prev_len = strlen(prev);
+    size_t text_len = strlen(text);
+    // cells past the end of a string are blank, same as a space
+    char old_cells[TIME_FIELD_LEN];
+    char new_cells[TIME_FIELD_LEN];
+    memset(old_cells, ' ', sizeof(old_cells));
+    memset(new_cells, ' ', sizeof(new_cells));
+    memcpy(old_cells, prev, prev_len);
+    memcpy(new_cells, text, text_len);
+
+    size_t len = MAX(prev_len, text_len);
+    size_t i = 0;
+    while (i < len) {
+        if (old_cells[i] == new_cells[i]) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < len && old_cells[i] != new_cells[i]) {
+            ++i;
+        }
+        char run[TIME_FIELD_LEN] = {};
+        memcpy(run, &new_cells[start], i - start);
+        if (asset_font) {
+            draw_text_font(&font, field->x + start * advance, field->y, run);
+        } else {
+            st7735_set_position(field->x + start * advance, field->y);
+            st7735_draw_str_bg(run, TIME_FG_COLOR, TIME_BG_COLOR, TIME_FONT);
+        }
+    }
+}
+
+/* Draw text with a font from the asset partition, in the colors of the time */
+static void draw_text_font(const asset_font_t *font, int x, int y, const char *str)
+{
+    for (; *str != '\0'; ++str, x += font->width) {
+        const uint8_t *glyph = asset_font_glyph(font, *str);
+        if (glyph == NULL) {
+            // not in the font, leave a blank cell
+            st7735_fill_rect(x, x + font->width - 1, y, y + font->height - 1, TIME_BG_COLOR);
+            continue;
+        }
+        st7735_draw_bitmap(x, y, font->width, font->height, glyph, TIME_FG_COLOR, TIME_BG_COLOR);
+    }
 }
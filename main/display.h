@@ -4,10 +4,30 @@ extern "C" {
 #endif
 
 #include <time.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
 
+/* Starts the LCD init sequence, drawing can start before it is finished */
 void display_init(void);
+/* Wait until the LCD init sequence is finished */
+void display_wait_ready(void);
+void display_sleep(void);
+/* Low power mode of the LCD for the always-on clock, with 8 colors */
+void display_set_ambient(bool enable);
 void display_hello(void);
+/* Same as display_render_time followed by display_update */
 void display_time(const struct tm *tm);
+/* Draw the time screen; with the framebuffer enabled, doesn't touch the LCD */
+void display_render_time(const struct tm *tm);
+/* Send what was drawn to the LCD */
+void display_update(void);
+void display_flush(void);
+/* Forget what the LCD shows, so that the next screen is drawn in full */
+void display_invalidate(void);
+#if CONFIG_ST7735_FRAMEBUFFER
+/* Draw the dial of the analog time screen, only into the framebuffer */
+void display_render_dial(const struct tm *tm);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,150 @@
+/**
+ *  T-Wristband display benchmark.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "display.h"
+#include "display_bench.h"
+#include "st7735.h"
+
+typedef struct {
+    const char *name;
+    void (*func)(void);
+} bench_case_t;
+
+static const char *TAG = "bench";
+
+/* Fixed time, so that the results are reproducible */
+static const struct tm s_bench_tm = {
+    .tm_year = 120, .tm_mon = 4, .tm_mday = 17, .tm_wday = 0,
+    .tm_hour = 12, .tm_min = 34, .tm_sec = 56
+};
+
+static void bench_clear_screen(void)
+{
+    st7735_clear_screen(0xffff);
+    st7735_update_screen();
+}
+
+static void bench_hello(void)
+{
+    display_hello();
+}
+
+/* Whole time screen, as drawn when it is shown */
+static void bench_time(void)
+{
+    display_invalidate();
+    display_time(&s_bench_tm);
+}
+
+/* Time screen update when the minute changes, as drawn every minute */
+static void bench_time_minute(void)
+{
+    static struct tm tm;
+    if (tm.tm_year == 0) {
+        tm = s_bench_tm;
+    }
+    tm.tm_min = (tm.tm_min + 1) % 60;
+    display_time(&tm);
+}
+
+static void bench_text(void)
+{
+    st7735_set_position(4, 4);
+    st7735_draw_str("0123456789", 0x007b, X3);
+    st7735_update_screen();
+}
+
+static void bench_text_bg(void)
+{
+    st7735_set_position(4, 4);
+    st7735_draw_str_bg("0123456789", 0x007b, 0xffff, X3);
+    st7735_update_screen();
+}
+
+static void bench_lines(void)
+{
+    for (int i = 0; i < 8; ++i) {
+        st7735_draw_line(0, st7735_width() - 1, i * 10, st7735_height() - 1 - i * 10, 0x04af);
+    }
+    st7735_update_screen();
+}
+
+static void bench_lines_hv(void)
+{
+    for (int i = 0; i < 8; ++i) {
+        st7735_draw_line_h(0, st7735_width() - 1, i * 10, 0x04af);
+        st7735_draw_line_v(i * 20, 0, st7735_height() - 1, 0x04af);
+    }
+    st7735_update_screen();
+}
+
+static void bench_rects(void)
+{
+    for (int i = 0; i < 8; ++i) {
+        st7735_draw_rect(i * 4, st7735_width() - 1 - i * 4, i * 4, st7735_height() - 1 - i * 4, 0x04af);
+    }
+    st7735_fill_rect(40, 59, 30, 49, 0x007b);
+    st7735_update_screen();
+}
+
+#if CONFIG_ST7735_FRAMEBUFFER
+/* Only draws into the framebuffer, to time the anti-aliased drawing */
+static void bench_dial(void)
+{
+    display_render_dial(&s_bench_tm);
+}
+#endif
+
+static const bench_case_t s_bench_cases[] = {
+    { "clear_screen", &bench_clear_screen },
+    { "hello", &bench_hello },
+    { "time", &bench_time },
+    { "time_minute", &bench_time_minute },
+    { "text", &bench_text },
+    { "text_bg", &bench_text_bg },
+    { "lines", &bench_lines },
+    { "lines_hv", &bench_lines_hv },
+    { "rects", &bench_rects },
+#if CONFIG_ST7735_FRAMEBUFFER
+    { "dial", &bench_dial },
+#endif
+};
+
+void display_benchmark(int iterations)
+{
+    ESP_LOGI(TAG, "%d iterations, SPI clock %d MHz, times per iteration:",
+             iterations, CONFIG_ST7735_SPI_CLOCK_MHZ);
+    for (size_t i = 0; i < sizeof(s_bench_cases) / sizeof(s_bench_cases[0]); ++i) {
+        const bench_case_t *bench = &s_bench_cases[i];
+        st7735_stats_t stats;
+
+        st7735_flush();
+        st7735_reset_stats();
+        int64_t start = esp_timer_get_time();
+        for (int it = 0; it < iterations; ++it) {
+            bench->func();
+            st7735_flush();
+        }
+        int64_t end = esp_timer_get_time();
+        st7735_get_stats(&stats);
+
+        ESP_LOGI(TAG, "%-14s %7d us, %5" PRIu32 " transactions, %6" PRIu32 " bytes, bus %6" PRIu32 " us",
+                 bench->name, (int) (end - start) / iterations,
+                 stats.transactions / iterations, stats.bytes / iterations,
+                 stats.bus_time_us / iterations);
+    }
+
+#if CONFIG_ST7735_FRAMEBUFFER
+    display_time(&s_bench_tm);
+    st7735_dump_ppm(stdout);
+#endif
+}
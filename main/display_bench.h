@@ -0,0 +1,10 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void display_benchmark(int iterations);
+
+#ifdef __cplusplus
+}
+#endif
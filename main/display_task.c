@@ -0,0 +1,143 @@
+/**
+ *  T-Wristband display service task.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "display.h"
+#include "display_task.h"
+
+/* Below the event loop task, so that input is handled while a frame is sent */
+#define DISPLAY_TASK_PRIORITY   5
+#define DISPLAY_TASK_STACK      4096
+#define DISPLAY_QUEUE_LEN       8
+
+/** @enum Requests sent to the task */
+typedef enum {
+    DISPLAY_CMD_TIME,
+    DISPLAY_CMD_SLEEP,
+    DISPLAY_CMD_AMBIENT,
+} display_cmd_type_t;
+
+typedef struct {
+    display_cmd_type_t type;
+    int64_t time_us;        // when the request was made
+    struct tm tm;           // for DISPLAY_CMD_TIME
+    bool enable;            // for DISPLAY_CMD_AMBIENT
+} display_cmd_t;
+
+static void display_task(void *arg);
+
+static QueueHandle_t s_queue;
+static SemaphoreHandle_t s_sleep_done;
+static uint32_t s_frame_count;
+
+ESP_EVENT_DEFINE_BASE(DISPLAY_EVENT);
+static const char *TAG = "display";
+
+void display_task_start(void)
+{
+    s_queue = xQueueCreate(DISPLAY_QUEUE_LEN, sizeof(display_cmd_t));
+    s_sleep_done = xSemaphoreCreateBinary();
+    assert(s_queue && s_sleep_done);
+    BaseType_t res = xTaskCreate(&display_task, "display", DISPLAY_TASK_STACK, NULL,
+                                 DISPLAY_TASK_PRIORITY, NULL);
+    assert(res == pdPASS);
+    (void) res;
+}
+
+static void display_task_post(display_cmd_t *cmd)
+{
+    assert(s_queue != NULL);
+    cmd->time_us = esp_timer_get_time();
+    // the task empties the queue each frame, so this waits at most one frame
+    xQueueSend(s_queue, cmd, portMAX_DELAY);
+}
+
+void display_task_time(const struct tm *tm)
+{
+    display_cmd_t cmd = { .type = DISPLAY_CMD_TIME, .tm = *tm };
+    display_task_post(&cmd);
+}
+
+void display_task_sleep(void)
+{
+    display_cmd_t cmd = { .type = DISPLAY_CMD_SLEEP };
+    display_task_post(&cmd);
+    xSemaphoreTake(s_sleep_done, portMAX_DELAY);
+}
+
+void display_task_ambient(bool enable)
+{
+    display_cmd_t cmd = { .type = DISPLAY_CMD_AMBIENT, .enable = enable };
+    display_task_post(&cmd);
+}
+
+static void display_draw(const display_cmd_t *cmd, int requests, int64_t first_us)
+{
+    display_time(&cmd->tm);
+    display_flush();
+
+    display_frame_t frame = {
+        .frame = ++s_frame_count,
+        .requests = requests,
+        .latency_us = esp_timer_get_time() - first_us
+    };
+    ESP_LOGD(TAG, "frame %u: %d requests, %d us", (unsigned) frame.frame, requests,
+             (int) frame.latency_us);
+    // don't wait for the event loop, it may be busy posting the next request
+    esp_event_post(DISPLAY_EVENT, DISPLAY_FRAME_DONE, &frame, sizeof(frame), 0);
+}
+
+static void display_task(void *arg)
+{
+    while (true) {
+        display_cmd_t cmd;
+        xQueueReceive(s_queue, &cmd, portMAX_DELAY);
+
+        // take whatever else has arrived meanwhile; only the last screen is drawn
+        display_cmd_t screen = {};
+        int requests = 0;
+        int64_t first_us = 0;
+        bool sleep = false;
+        int ambient = -1;
+        do {
+            if (cmd.type == DISPLAY_CMD_SLEEP) {
+                // the screens requested before it are drawn first, later ones wait
+                sleep = true;
+                break;
+            }
+            if (cmd.type == DISPLAY_CMD_AMBIENT) {
+                // the mode is switched before drawing, the last request wins
+                ambient = cmd.enable;
+                continue;
+            }
+            if (requests++ == 0) {
+                first_us = cmd.time_us;
+            }
+            screen = cmd;
+        } while (xQueueReceive(s_queue, &cmd, 0) == pdTRUE);
+
+        if (ambient >= 0) {
+            display_set_ambient(ambient);
+            if (requests == 0) {
+                display_flush();
+            }
+        }
+        if (requests > 0) {
+            display_draw(&screen, requests, first_us);
+        }
+        if (sleep) {
+            display_sleep();
+            xSemaphoreGive(s_sleep_done);
+        }
+    }
+}
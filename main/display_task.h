@@ -0,0 +1,41 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "esp_event.h"
+
+/* Display service: a task which owns the LCD once started. Other tasks and
+ * event handlers only post requests, and don't wait for the SPI transfers.
+ * Requests which arrive while a frame is drawn are merged, only the last
+ * screen requested is drawn.
+ */
+
+ESP_EVENT_DECLARE_BASE(DISPLAY_EVENT);
+
+/* Display event IDs */
+enum {
+    DISPLAY_FRAME_DONE,     /* data: display_frame_t */
+};
+
+typedef struct {
+    uint32_t frame;         /* number of frames sent so far */
+    int requests;           /* number of requests merged into this frame */
+    int64_t latency_us;     /* from the first of them to the frame being sent */
+} display_frame_t;
+
+/* Start the task; display_* functions must not be called directly after this */
+void display_task_start(void);
+/* Show the time screen */
+void display_task_time(const struct tm *tm);
+/* Switch the LCD to or from its low power mode (see display_set_ambient) */
+void display_task_ambient(bool enable);
+/* Draw what was requested before, then put the LCD to sleep. Blocks until done. */
+void display_task_sleep(void);
+
+#ifdef __cplusplus
+}
+#endif
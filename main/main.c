@@ -6,19 +6,25 @@
  */
 
 #include <stdio.h>
+#include <unistd.h>
 #include "esp_log.h"
 #include "esp_event.h"
 #include "board.h"
-#include "sleep_timeout.h"
+#include "power_state.h"
 #include "display.h"
-#include "pcf8563.h"
+#include "display_task.h"
+#include "display_bench.h"
+#include "boot_profile.h"
+#include "time_service.h"
+#include "ambient_clock.h"
 
-#define SLEEP_TIMEOUT_MS 3000
+/* backlight in POWER_STATE_DIMMED, percent */
+#define DIMMED_BRIGHTNESS 20
 
 #define EVENT_HANDLER(name_) void name_(void* arg, esp_event_base_t base, int id, void* data)
 
 static void register_handlers(void);
-static EVENT_HANDLER(on_sleep_timeout);
+static EVENT_HANDLER(on_power_state_changed);
 static EVENT_HANDLER(on_touchpad_press);
 static EVENT_HANDLER(on_touchpad_long_press);
 
@@ -27,51 +33,118 @@ static const char *TAG = "main";
 
 void app_main(void)
 {
+    boot_profile_mark("app_main");
     esp_event_loop_create_default();
     register_handlers();
 
     board_config_t board_config = BOARD_CONFIG_DEFAULT();
     board_init(&board_config);
-    board_rtc_init();
-    board_touchpad_enable();
-    board_lcd_enable();
 
+    /* LCD init mostly consists of waiting, it runs in the background
+     * while the RTC is read and the time screen is rendered.
+     */
+    board_lcd_enable();
     display_init();
+    boot_profile_mark("lcd_start");
+
+    board_rtc_init();
+    boot_profile_mark("rtc_init");
+    board_touchpad_enable();
+    boot_profile_mark("board_init");
 
+    time_service_init();
+    boot_profile_mark("rtc_read");
     struct tm tm;
-    pcf8563_get_time(&tm);
-    display_time(&tm);
+    time_service_get(&tm);
+    display_render_time(&tm);
+    boot_profile_mark("render");
+
+    display_wait_ready();
+    boot_profile_mark("lcd_ready");
 
     /* only turn on the backlight when finished drawing */
+    display_update();
+    display_flush();
     board_lcd_backlight(true);
-
-    sleep_timeout_init(SLEEP_TIMEOUT_MS);
+    boot_profile_mark("first_pixel");
+
+#if CONFIG_APP_BOOT_PROFILE
+    boot_profile_report();
+#endif
+
+#if CONFIG_APP_DISPLAY_BENCHMARK
+    display_benchmark(CONFIG_APP_DISPLAY_BENCHMARK_ITERATIONS);
+#endif
+
+    /* from here on, the LCD is only drawn to by the display task */
+    display_task_start();
+
+    power_config_t power_config = POWER_CONFIG_DEFAULT();
+#if CONFIG_APP_ALWAYS_ON_CLOCK
+    /* the clock stays on until touched */
+    power_config.timeout_ms[POWER_STATE_SCREEN_OFF] = POWER_TIMEOUT_NEVER;
+    ambient_clock_init();
+#endif
+    power_state_init(&power_config);
 }
 
 static void register_handlers(void)
 {
-    ESP_ERROR_CHECK(esp_event_handler_register(SLEEP_EVENT, SLEEP_TIMEOUT, &on_sleep_timeout, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(POWER_EVENT, POWER_STATE_CHANGED, &on_power_state_changed, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(BOARD_EVENT, TOUCHPAD_PRESS, &on_touchpad_press, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(BOARD_EVENT, TOUCHPAD_LONG_PRESS, &on_touchpad_long_press, NULL));
 }
 
-static EVENT_HANDLER(on_sleep_timeout)
+static EVENT_HANDLER(on_power_state_changed)
 {
-    ESP_LOGI(TAG, "Entering sleep");
-    fflush(stdout);
-    fsync(fileno(stdout));
-
-    board_sleep();
+    power_state_t state = *(power_state_t *) data;
+    switch (state) {
+    case POWER_STATE_ACTIVE: {
+        /* the time may have changed while the screen was off */
+        board_touchpad_light_sleep_wakeup(false);
+#if CONFIG_APP_ALWAYS_ON_CLOCK
+        ambient_clock_exit();
+#endif
+        struct tm tm;
+        time_service_get(&tm);
+        display_task_time(&tm);
+        board_lcd_brightness(100);
+        break;
+    }
+    case POWER_STATE_DIMMED:
+        board_lcd_brightness(DIMMED_BRIGHTNESS);
+        break;
+    case POWER_STATE_SCREEN_OFF:
+        board_touchpad_light_sleep_wakeup(true);
+#if CONFIG_APP_ALWAYS_ON_CLOCK
+        ambient_clock_enter();
+#else
+        board_lcd_brightness(0);
+#endif
+        break;
+    case POWER_STATE_DEEP_SLEEP:
+        ESP_LOGI(TAG, "Entering sleep");
+        fflush(stdout);
+        fsync(fileno(stdout));
+
+        display_task_sleep();
+        board_sleep();
+        break;
+    }
 }
 
 static EVENT_HANDLER(on_touchpad_press)
 {
     ESP_LOGI(TAG, "Touchpad press");
-    sleep_timeout_reset();
+    power_state_activity();
+
+    struct tm tm;
+    time_service_get(&tm);
+    display_task_time(&tm);
 }
 
 static EVENT_HANDLER(on_touchpad_long_press)
 {
     ESP_LOGI(TAG, "Touchpad long press");
-    sleep_timeout_reset();
+    power_state_activity();
 }
@@ -0,0 +1,142 @@
+/**
+ *  T-Wristband power states.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp32/pm.h"
+#include "sdkconfig.h"
+#include "power_state.h"
+
+/* Lowest CPU frequency used when idle */
+#define POWER_MIN_FREQ_MHZ  40
+
+static void power_timer_cb(void *arg);
+
+static power_config_t s_config;
+static esp_timer_handle_t s_timer;
+/* Time of the last activity, in ms. Written from any task without locking;
+ * 32-bit stores are atomic, and the timer callback checks it again after
+ * changing the state.
+ */
+static volatile uint32_t s_activity_ms;
+static volatile power_state_t s_state;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t s_cpu_lock;
+static esp_pm_lock_handle_t s_no_sleep_lock;
+#endif
+
+ESP_EVENT_DEFINE_BASE(POWER_EVENT);
+static const char *TAG = "power";
+
+static uint32_t power_now_ms(void)
+{
+    return (uint32_t) (esp_timer_get_time() / 1000);
+}
+
+void power_state_init(const power_config_t *config)
+{
+    s_config = *config;
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true
+#endif
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "active", &s_cpu_lock));
+    /* keep input responsive while the screen is on */
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "screen_on", &s_no_sleep_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(s_cpu_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(s_no_sleep_lock));
+#endif
+    s_state = POWER_STATE_ACTIVE;
+    s_activity_ms = power_now_ms();
+
+    esp_timer_create_args_t args = {
+        .callback = &power_timer_cb,
+        .name = "power_state"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &s_timer));
+    ESP_ERROR_CHECK(esp_timer_start_once(s_timer, 0));
+}
+
+void power_state_activity(void)
+{
+    s_activity_ms = power_now_ms();
+    if (s_state != POWER_STATE_ACTIVE && s_state != POWER_STATE_DEEP_SLEEP) {
+        /* let the timer callback wake up */
+        esp_timer_stop(s_timer);
+        esp_timer_start_once(s_timer, 0);
+    }
+}
+
+power_state_t power_state_get(void)
+{
+    return s_state;
+}
+
+/* Take the power management locks of the new state before releasing the
+ * ones of the old state, so that going up doesn't pass through light sleep.
+ */
+static void power_state_set(power_state_t state)
+{
+    power_state_t prev = s_state;
+    if (state == prev) {
+        return;
+    }
+#if CONFIG_PM_ENABLE
+    if (state == POWER_STATE_ACTIVE) {
+        esp_pm_lock_acquire(s_cpu_lock);
+    }
+    if (state <= POWER_STATE_DIMMED && prev > POWER_STATE_DIMMED) {
+        esp_pm_lock_acquire(s_no_sleep_lock);
+    }
+    if (prev == POWER_STATE_ACTIVE) {
+        esp_pm_lock_release(s_cpu_lock);
+    }
+    if (prev <= POWER_STATE_DIMMED && state > POWER_STATE_DIMMED) {
+        esp_pm_lock_release(s_no_sleep_lock);
+    }
+#endif
+    s_state = state;
+    ESP_LOGD(TAG, "state %d -> %d", prev, state);
+    ESP_ERROR_CHECK(esp_event_post(POWER_EVENT, POWER_STATE_CHANGED, &state, sizeof(state), portMAX_DELAY));
+}
+
+static void power_timer_cb(void *arg)
+{
+    uint32_t activity_ms;
+    do {
+        activity_ms = s_activity_ms;
+        uint32_t idle_ms = power_now_ms() - activity_ms;
+        /* state for the time without activity, and when it ends */
+        power_state_t state = POWER_STATE_ACTIVE;
+        uint32_t end_ms = 0;
+        while (state < POWER_STATE_DEEP_SLEEP) {
+            if (s_config.timeout_ms[state] == POWER_TIMEOUT_NEVER) {
+                break;
+            }
+            end_ms += s_config.timeout_ms[state];
+            if (idle_ms < end_ms) {
+                break;
+            }
+            ++state;
+        }
+        power_state_set(state);
+        if (state != POWER_STATE_DEEP_SLEEP &&
+                s_config.timeout_ms[state] != POWER_TIMEOUT_NEVER) {
+            esp_timer_stop(s_timer);
+            esp_timer_start_once(s_timer, (uint64_t) (end_ms - idle_ms) * 1000);
+        }
+        /* activity while the state was changed may have missed the wakeup */
+    } while (s_state != POWER_STATE_DEEP_SLEEP && activity_ms != s_activity_ms);
+}
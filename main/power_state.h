@@ -0,0 +1,53 @@
+#pragma once
+
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Power states, from the most to the least power. Without user activity,
+ * each state is left for the next one after its timeout; any activity
+ * returns to POWER_STATE_ACTIVE, except from deep sleep.
+ */
+typedef enum {
+    POWER_STATE_ACTIVE,         /* full brightness, CPU at full speed */
+    POWER_STATE_DIMMED,         /* dimmed backlight, CPU frequency scaled down when idle */
+    POWER_STATE_SCREEN_OFF,     /* backlight off, light sleep when idle */
+    POWER_STATE_DEEP_SLEEP,     /* final, LCD asleep and chip in deep sleep */
+} power_state_t;
+
+/* Timeout of a state which is only left on activity */
+#define POWER_TIMEOUT_NEVER (-1)
+
+typedef struct {
+    /* time without activity before going to the next state; 0 skips a state */
+    int timeout_ms[POWER_STATE_DEEP_SLEEP];
+} power_config_t;
+
+#define POWER_CONFIG_DEFAULT() (power_config_t) { \
+    .timeout_ms = { \
+        [POWER_STATE_ACTIVE] = 3000, \
+        [POWER_STATE_DIMMED] = 2000, \
+        [POWER_STATE_SCREEN_OFF] = 10000, \
+    } \
+}
+
+ESP_EVENT_DECLARE_BASE(POWER_EVENT);
+
+/* Power event IDs */
+enum {
+    POWER_STATE_CHANGED,    /* data: power_state_t, the new state */
+};
+
+/* Configure power management and start in POWER_STATE_ACTIVE */
+void power_state_init(const power_config_t *config);
+/* Restart the timeouts. Only records the time while active, so it is cheap
+ * to call on every input event.
+ */
+void power_state_activity(void);
+power_state_t power_state_get(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,51 @@
+/**
+ *  T-Wristband time keeping.
+ *
+ *  Copyright (c) 2020 Ivan Grokhotkov
+ *  Distributed under MIT license as displayed in LICENSE file.
+ */
+
+#include <sys/time.h>
+#include "esp_log.h"
+#include "pcf8563.h"
+#include "time_service.h"
+
+static const char *TAG = "time";
+
+/* The RTC keeps local time; no TZ is set, so mktime and localtime_r
+ * convert it without any offset.
+ */
+static void time_service_set_system(struct tm *tm)
+{
+    struct timeval tv = {
+        .tv_sec = mktime(tm)
+    };
+    settimeofday(&tv, NULL);
+}
+
+void time_service_init(void)
+{
+    time_service_reload();
+    ESP_LOGI(TAG, "time loaded from RTC");
+}
+
+void time_service_reload(void)
+{
+    struct tm tm;
+    pcf8563_get_time(&tm);
+    time_service_set_system(&tm);
+}
+
+void time_service_get(struct tm *out)
+{
+    time_t now = time(NULL);
+    localtime_r(&now, out);
+}
+
+void time_service_set(const struct tm *tm)
+{
+    struct tm tmp = *tm;
+    time_service_set_system(&tmp);
+    // normalized by mktime, with the weekday filled in
+    pcf8563_set_time(&tmp);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+
+/* The RTC is read once per boot, into the system clock. After that the time
+ * comes from the system clock, without any I2C transfers, and the RTC is
+ * only written to when the time is set. Long stretches of light sleep are
+ * timed by the less accurate RTC_SLOW_CLK, time_service_reload corrects
+ * the drift.
+ */
+
+/* Load the time from the RTC into the system clock */
+void time_service_init(void);
+/* Read the RTC again, after the system clock may have drifted */
+void time_service_reload(void);
+/* Current local time, from the system clock */
+void time_service_get(struct tm *out);
+/* Set the time of the system clock and of the RTC, e.g. after a sync */
+void time_service_set(const struct tm *tm);
+
+#ifdef __cplusplus
+}
+#endif
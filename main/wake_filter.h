@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int (*wake_filter_read_fn_t)(void);
+typedef void (*wake_filter_delay_fn_t)(uint32_t us);
+
+/* Check if a touch which caused a wakeup is sustained.
+ *
+ * Samples 'read_level' every 'sample_us', for 'hold_us' in total. Returns
+ * true if the level stays high all this time, with low glitches shorter than
+ * 'debounce_us' ignored. Returns false as soon as the line is low longer.
+ *
+ * Always inlined and free of any hardware access, so that it ends up in the
+ * RTC fast memory of the deep sleep wake stub calling it, and can be run on
+ * the host against a recorded pin trace (host_test/test_wake_filter.c).
+ */
+static inline __attribute__((always_inline)) bool wake_filter_touch_held(wake_filter_read_fn_t read_level,
+                                          wake_filter_delay_fn_t delay,
+                                          uint32_t hold_us, uint32_t debounce_us,
+                                          uint32_t sample_us)
+{
+    uint32_t low_us = 0;
+    for (uint32_t t = 0; t < hold_us; t += sample_us) {
+        if (read_level()) {
+            low_us = 0;
+        } else {
+            low_us += sample_us;
+            if (low_us >= debounce_us) {
+                return false;
+            }
+        }
+        delay(sample_us);
+    }
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
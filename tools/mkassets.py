@@ -0,0 +1,258 @@
+#!/usr/bin/env python
+#
+#  Build the asset pack for the "assets" partition of T-Wristband.
+#
+#  Copyright (c) 2020 Ivan Grokhotkov
+#  Distributed under MIT license as displayed in LICENSE file.
+#
+#  Fonts are read from BDF files, images from binary PPM (P6) files.
+#  Images are stored QOI compressed if that makes them smaller (see
+#  https://qoiformat.org), unless --raw is given.
+#  The pack layout is described in components/assets/assets.h.
+#
+#  Example:
+#    mkassets.py -o build/assets.bin --font big=fonts/10x20.bdf --image hello=hello.ppm
+#    parttool.py write_partition --partition-name assets --input build/assets.bin
+#    mkassets.py --list build/assets.bin
+
+from __future__ import print_function
+import argparse
+import struct
+import sys
+
+MAGIC = 0x53415754  # "TWAS"
+VERSION = 1
+NAME_LEN = 16
+TYPE_FONT = 1
+TYPE_IMAGE = 2
+TYPE_QOI = 3
+TYPE_NAMES = {TYPE_FONT: 'font', TYPE_IMAGE: 'image', TYPE_QOI: 'qoi'}
+
+HEADER = struct.Struct('<IHHI')
+ENTRY = struct.Struct('<%dsIII' % NAME_LEN)
+
+
+def rgb565(r, g, b):
+    # the LCD is in BGR mode: blue in the upper bits, red in the lower ones
+    v = ((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3)
+    # stored in the byte order it is sent in
+    return struct.pack('>H', v)
+
+
+def read_ppm_tokens(data):
+    # header fields separated by whitespace, with comments; then the pixels
+    tokens = []
+    pos = 0
+    while len(tokens) < 4:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b'#':
+            while data[pos:pos + 1] not in (b'\n', b''):
+                pos += 1
+            continue
+        start = pos
+        while not data[pos:pos + 1].isspace():
+            pos += 1
+        tokens.append(data[start:pos])
+    return tokens, pos + 1
+
+
+def read_ppm(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    (magic, width, height, maxval), pos = read_ppm_tokens(data)
+    if magic != b'P6' or int(maxval) != 255:
+        raise ValueError('%s: only binary PPM with 8 bits per component is supported' % path)
+    width = int(width)
+    height = int(height)
+    pixels = data[pos:pos + width * height * 3]
+    if len(pixels) != width * height * 3:
+        raise ValueError('%s: file is too short' % path)
+    # only the bits which make it to the LCD are kept, which helps compression
+    pixels = bytearray(pixels)
+    for i in range(0, len(pixels), 3):
+        pixels[i] &= 0xf8
+        pixels[i + 1] &= 0xfc
+        pixels[i + 2] &= 0xf8
+    return width, height, pixels
+
+
+def encode_raw(width, height, pixels):
+    out = bytearray(struct.pack('<HH', width, height))
+    for i in range(0, len(pixels), 3):
+        r, g, b = pixels[i:i + 3]
+        out += rgb565(r, g, b)
+    return bytes(out)
+
+
+def encode_qoi(width, height, pixels):
+    out = bytearray(b'qoif' + struct.pack('>IIBB', width, height, 3, 0))
+    index = [None] * 64
+    prev = (0, 0, 0)
+    run = 0
+    for i in range(0, len(pixels), 3):
+        px = tuple(pixels[i:i + 3])
+        if px == prev:
+            run += 1
+            if run == 62:
+                out.append(0xc0 | (run - 1))
+                run = 0
+            continue
+        if run:
+            out.append(0xc0 | (run - 1))
+            run = 0
+        r, g, b = px
+        h = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64
+        if index[h] == px:
+            out.append(h)
+        else:
+            index[h] = px
+            dr = (r - prev[0] + 128) % 256 - 128
+            dg = (g - prev[1] + 128) % 256 - 128
+            db = (b - prev[2] + 128) % 256 - 128
+            if -2 <= dr < 2 and -2 <= dg < 2 and -2 <= db < 2:
+                out.append(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2))
+            elif -32 <= dg < 32 and -8 <= dr - dg < 8 and -8 <= db - dg < 8:
+                out += bytearray([0x80 | (dg + 32), ((dr - dg + 8) << 4) | (db - dg + 8)])
+            else:
+                out += bytearray([0xfe, r, g, b])
+        prev = px
+    if run:
+        out.append(0xc0 | (run - 1))
+    out += b'\0' * 7 + b'\1'
+    return bytes(out)
+
+
+def load_image(name, path, raw=False):
+    width, height, pixels = read_ppm(path)
+    data = encode_raw(width, height, pixels)
+    if not raw:
+        qoi = encode_qoi(width, height, pixels)
+        if len(qoi) < len(data):
+            return name, TYPE_QOI, qoi
+    return name, TYPE_IMAGE, data
+
+
+def load_font(path, first=0x20, last=0x7e):
+    # glyphs are placed into cells of the font bounding box
+    glyphs = {}
+    with open(path) as f:
+        lines = iter(f.read().splitlines())
+    cell_w = cell_h = cell_x = cell_y = 0
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == 'FONTBOUNDINGBOX':
+            cell_w, cell_h, cell_x, cell_y = [int(v) for v in fields[1:5]]
+        elif fields[0] == 'STARTCHAR':
+            code = None
+            bbx = None
+            for line in lines:
+                fields = line.split() or ['']
+                if fields[0] == 'ENCODING':
+                    code = int(fields[1])
+                elif fields[0] == 'BBX':
+                    bbx = [int(v) for v in fields[1:5]]
+                elif fields[0] == 'BITMAP':
+                    break
+            rows = []
+            for line in lines:
+                if line.strip() == 'ENDCHAR':
+                    break
+                rows.append(int(line.strip(), 16) << (32 - len(line.strip()) * 4))
+            if code is not None and first <= code <= last:
+                glyphs[code] = (bbx, rows)
+    if not glyphs:
+        raise ValueError('%s: no glyphs in range 0x%02x-0x%02x' % (path, first, last))
+    if cell_w > 32 or cell_h > 255:
+        raise ValueError('%s: glyphs are too large, at most 32 pixels wide' % path)
+
+    row_bytes = (cell_w + 7) // 8
+    out = bytearray(struct.pack('<BBBB', cell_w, cell_h, first, last - first + 1))
+    for code in range(first, last + 1):
+        cell = [0] * cell_h
+        if code in glyphs:
+            (w, h, x, y), rows = glyphs[code]
+            # row of the cell where the glyph bitmap starts, from the top
+            top = (cell_h + cell_y) - (h + y)
+            for i, bits in enumerate(rows):
+                if 0 <= top + i < cell_h:
+                    cell[top + i] = (bits >> (x - cell_x)) & 0xffffffff
+        for bits in cell:
+            out += struct.pack('>I', bits)[:row_bytes]
+    return bytes(out)
+
+
+def build(entries):
+    index_end = HEADER.size + ENTRY.size * len(entries)
+    offset = (index_end + 3) & ~3
+    index = b''
+    blobs = b'\0' * (offset - index_end)
+    for name, type_, data in entries:
+        if len(name.encode()) > NAME_LEN:
+            raise ValueError('name is too long: %s' % name)
+        index += ENTRY.pack(name.encode(), type_, offset, len(data))
+        padded = data + b'\0' * (-len(data) % 4)
+        blobs += padded
+        offset += len(padded)
+    return HEADER.pack(MAGIC, VERSION, len(entries), offset) + index + blobs
+
+
+def list_pack(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, version, count, size = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('%s: not an asset pack of version %d' % (path, VERSION))
+    print('%d assets, %d bytes' % (count, size))
+    for i in range(count):
+        name, type_, offset, length = ENTRY.unpack_from(data, HEADER.size + i * ENTRY.size)
+        name = name.rstrip(b'\0').decode()
+        if type_ == TYPE_IMAGE:
+            w, h = struct.unpack_from('<HH', data, offset)
+            info = '%dx%d' % (w, h)
+        elif type_ == TYPE_QOI:
+            w, h = struct.unpack_from('>II', data, offset + 4)
+            info = '%dx%d, %d%% of raw' % (w, h, 100 * length // (w * h * 2 + 4))
+        else:
+            w, h, first, n = struct.unpack_from('<BBBB', data, offset)
+            info = '%dx%d, %d chars from 0x%02x' % (w, h, n, first)
+        print('%-16s %-5s %7d bytes at 0x%06x, %s' % (name, TYPE_NAMES.get(type_, '?'), length, offset, info))
+
+
+def named_path(arg):
+    name, sep, path = arg.partition('=')
+    if not sep:
+        raise argparse.ArgumentTypeError('expected NAME=FILE')
+    return name, path
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build the T-Wristband asset pack')
+    parser.add_argument('-o', '--output', help='asset pack to write')
+    parser.add_argument('--font', action='append', default=[], type=named_path,
+                        metavar='NAME=BDF', help='add a font')
+    parser.add_argument('--image', action='append', default=[], type=named_path,
+                        metavar='NAME=PPM', help='add an image')
+    parser.add_argument('--raw', action='store_true', help='store images uncompressed')
+    parser.add_argument('--list', metavar='PACK', help='print the contents of an asset pack')
+    args = parser.parse_args()
+
+    try:
+        if args.list:
+            list_pack(args.list)
+            return
+        if not args.output:
+            parser.error('no output file given')
+        entries = [(name, TYPE_FONT, load_font(path)) for name, path in args.font]
+        entries += [load_image(name, path, args.raw) for name, path in args.image]
+        with open(args.output, 'wb') as f:
+            f.write(build(entries))
+    except (IOError, ValueError) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()